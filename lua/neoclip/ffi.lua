@@ -0,0 +1,158 @@
+--[[
+    neoclip - Neovim clipboard provider
+    Last Change:    2026 Oct 16
+    License:        https://unlicense.org
+    URL:            https://github.com/matveyt/neoclip
+--]]
+
+
+local ffi = require"ffi"
+local neoclip = require"neoclip"
+
+
+local neoffi = {
+    -- lib = ffi.load(driver) or false
+    -- driver = neoclip.driver that lib was loaded for
+    --
+    -- load()
+    -- acquire(reg)
+    -- get(reg)
+    -- set(reg, str, regtype)
+    -- write(reg, cb, regtype, fill)
+}
+
+
+ffi.cdef[[
+const char* neoclip_acquire(const char* reg, size_t* pcb, int* ptype);
+void neoclip_release(const char* ptr);
+char* neoclip_alloc(size_t cb);
+bool neoclip_publish(const char* reg, char* ptr, size_t cb, const char* regtype);
+size_t* neoclip_lines(const char* ptr, size_t cb, size_t* pcount);
+void neoclip_free(void* ptr);
+]]
+
+
+-- MCHAR, MLINE, MBLOCK
+local regtypes = { [0] = "v", "V", "\22" }
+
+
+-- selection snapshot { ptr, cb, regtype }
+local snapshot = {}
+snapshot.__index = snapshot
+
+function snapshot:string()
+    return ffi.string(self.ptr, self.cb)
+end
+
+-- for ptr, len in snap:lines() do ... end
+function snapshot:lines()
+    local lib = neoffi.lib
+    local ptr, cb = self.ptr, self.cb
+    local count = ffi.new"size_t[1]"
+    local lf = ffi.gc(lib.neoclip_lines(ptr, cb, count), lib.neoclip_free)
+    local i, n, off = 0, tonumber(count[0]), 0
+
+    return function()
+        if i > n then
+            return nil
+        end
+        local eol = (i < n) and tonumber(lf[i]) or cb
+        local len = eol - off
+        if len > 0 and ptr[eol - 1] == 13 then
+            len = len - 1   -- w/o CR
+        end
+        local line = ptr + off
+        i, off = i + 1, eol + 1
+        return line, len
+    end
+end
+
+function snapshot:release()
+    if self.ptr then
+        neoffi.lib.neoclip_release(ffi.gc(self.ptr, nil))
+        self.ptr, self.cb = nil, 0
+    end
+end
+
+
+function neoffi.load()
+    if neoffi.driver ~= neoclip.driver then
+        neoffi.lib, neoffi.driver = false, neoclip.driver
+        for name, module in pairs(_G.package.loaded) do
+            if module == neoclip.driver then
+                local path = _G.package.searchpath(name, _G.package.cpath)
+                local status, lib = pcall(ffi.load, path)
+                if status and pcall(function() return lib.neoclip_acquire end) then
+                    neoffi.lib = lib
+                end
+                break
+            end
+        end
+    end
+
+    return neoffi.lib
+end
+
+-- snapshot or nil; must be released
+function neoffi.acquire(reg)
+    local lib = neoffi.load()
+    if not lib or not neoclip.driver.fetch(reg) then
+        return nil
+    end
+
+    local pcb, ptype = ffi.new"size_t[1]", ffi.new"int[1]"
+    local ptr = lib.neoclip_acquire(reg, pcb, ptype)
+    if ptr == nil then
+        return nil
+    end
+
+    return setmetatable({
+        ptr = ffi.gc(ptr, lib.neoclip_release),
+        cb = tonumber(pcb[0]),
+        regtype = regtypes[ptype[0]],
+    }, snapshot)
+end
+
+-- same as driver.get_raw
+function neoffi.get(reg)
+    if not neoffi.load() then
+        return neoclip.driver.get_raw(reg)
+    end
+
+    local snap = neoffi.acquire(reg)
+    if snap then
+        local str, regtype = snap:string(), snap.regtype
+        snap:release()
+        return str, regtype
+    end
+end
+
+-- same as driver.set_raw
+function neoffi.set(reg, str, regtype)
+    return neoffi.write(reg, #str, regtype, function(ptr, cb) ffi.copy(ptr, str, cb) end)
+end
+
+-- fill(ptr, cb) writes selection text directly
+function neoffi.write(reg, cb, regtype, fill)
+    local lib = neoffi.load()
+    if not lib then
+        local buf = ffi.new("char[?]", cb)
+        fill(buf, cb)
+        return neoclip.driver.set_raw(reg, ffi.string(buf, cb), regtype)
+    end
+
+    local ptr = lib.neoclip_alloc(cb)
+    if ptr == nil and cb > 0 then
+        return false
+    end
+    local status, result = pcall(fill, ptr, cb)
+    if not status then
+        lib.neoclip_release(ptr)
+        error(result)
+    end
+
+    return lib.neoclip_publish(reg, ptr, cb, regtype)
+end
+
+
+return neoffi
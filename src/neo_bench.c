@@ -0,0 +1,375 @@
+/*
+ * neoclip - Neovim clipboard provider
+ * Last Change:  2026 Oct 16
+ * License:      https://unlicense.org
+ * URL:          https://github.com/matveyt/neoclip
+ */
+
+
+#include "neoclip_nix.h"
+#include <stdio.h>
+#include <time.h>
+#include <lualib.h>
+
+
+// in-memory driver state
+struct neo_X {
+    uint8_t* data[sel_total];   // Selection: _VIMENC_TEXT
+    size_t cb[sel_total];       // Selection: text size only
+};
+
+// test corpus
+typedef struct {
+    const char* name;           // corpus name
+    char* ptr;                  // text
+    size_t cb;                  // text size
+    size_t lines;               // lines count
+} corpus;
+
+// benchmark operation
+typedef struct {
+    const char* name;           // operation name
+    void (*fn)(lua_State* L, corpus* c);
+} operation;
+
+int luaopen_driver(lua_State* L);
+static void make_corpus(corpus* c, const char* name, size_t cb);
+static double now(void);
+static int cmp_double(const void* p1, const void* p2);
+static void call_driver(lua_State* L, const char* method, int nargs, int nresults);
+static void op_split(lua_State* L, corpus* c);
+static void op_join(lua_State* L, corpus* c);
+static void op_get(lua_State* L, corpus* c);
+static void op_get_raw(lua_State* L, corpus* c);
+static void op_set(lua_State* L, corpus* c);
+static void op_set_raw(lua_State* L, corpus* c);
+
+
+// bench [MB [runs]]
+int main(int argc, char* argv[])
+{
+    size_t cb = (argc > 1) ? strtoul(argv[1], NULL, 10) << 20 : 16 << 20;
+    int runs = (argc > 2) ? atoi(argv[2]) : 20;
+    if (cb == 0 || runs < 1) {
+        fprintf(stderr, "usage: %s [MB [runs]]\n", argv[0]);
+        return 1;
+    }
+
+    static const char* const names[] = {
+        "ascii", "cjk", "emoji", "crlf", "huge_line", "tiny_lines", "garbage",
+    };
+    static const operation ops[] = {
+        { "split", op_split },
+        { "join", op_join },
+        { "set", op_set },
+        { "set_raw", op_set_raw },  // must precede get
+        { "get", op_get },
+        { "get_raw", op_get_raw },
+    };
+
+    // embedded LuaJIT with in-memory driver
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+    lua_pushliteral(L, "neoclip.bench-driver");
+    luaopen_driver(L);
+    lua_setglobal(L, "driver");
+    lua_settop(L, 0);
+    call_driver(L, "start", 0, 0);
+
+    double* t = malloc(runs * sizeof(double));
+    printf("%-12s %-8s %10s %10s %10s %12s %12s %12s\n", "corpus", "op",
+        "MB/s p50", "MB/s p90", "MB/s p99", "lines/s p50", "lines/s p90",
+        "lines/s p99");
+
+    for (size_t i = 0; i < _countof(names); ++i) {
+        corpus c;
+        make_corpus(&c, names[i], cb);
+
+        // text and [lines, regtype] for set
+        lua_pushlstring(L, c.ptr, c.cb);
+        lua_setglobal(L, "text");
+        lua_createtable(L, 2, 0);
+        neo_split(L, -1, c.ptr, c.cb, MAUTO);
+        lua_setglobal(L, "lines");
+
+        for (size_t j = 0; j < _countof(ops); ++j) {
+            for (int k = 0; k < runs; ++k) {
+                double t0 = now();
+                ops[j].fn(L, &c);
+                t[k] = now() - t0;
+                lua_settop(L, 0);
+                lua_gc(L, LUA_GCCOLLECT, 0);
+            }
+
+            // percentiles by time: p90 is slower than p50
+            qsort(t, runs, sizeof(double), cmp_double);
+            double p50 = t[(runs - 1) * 50 / 100];
+            double p90 = t[(runs - 1) * 90 / 100];
+            double p99 = t[(runs - 1) * 99 / 100];
+            double mb = (double)c.cb / (1 << 20);
+            printf("%-12s %-8s %10.1f %10.1f %10.1f %12.0f %12.0f %12.0f\n", c.name,
+                ops[j].name, mb / p50, mb / p90, mb / p99, c.lines / p50,
+                c.lines / p90, c.lines / p99);
+        }
+
+        lua_pushnil(L);
+        lua_setglobal(L, "text");
+        lua_pushnil(L);
+        lua_setglobal(L, "lines");
+        free(c.ptr);
+    }
+
+    free(t);
+    call_driver(L, "stop", 0, 0);
+    lua_close(L);
+    return 0;
+}
+
+
+// in-memory driver: init state
+int neo_start(lua_State* L)
+{
+    neo_X* x = neo_x(L);
+    if (x == NULL) {
+        // create new state
+        x = lua_newuserdata(L, sizeof(neo_X));
+        for (size_t i = 0; i < sel_total; ++i) {
+            x->data[i] = NULL;
+            x->cb[i] = 0;
+        }
+
+        // metatable for state
+        luaL_newmetatable(L, lua_tostring(L, uv_module));
+        neo_pushcfunction(L, neo__gc);
+        lua_setfield(L, -2, "__gc");
+        lua_setmetatable(L, -2);
+
+        // uv_share.x = x
+        lua_setfield(L, uv_share, "x");
+        neo_ffi_x = x;
+    }
+
+    lua_pushnil(L);
+    return 1;
+}
+
+
+// in-memory driver: destroy state
+int neo__gc(lua_State* L)
+{
+    neo_X* x = (neo_X*)neo_checkud(L, 1);
+    if (neo_ffi_x == x)
+        neo_ffi_x = NULL;
+
+    for (size_t i = 0; i < sel_total; ++i)
+        neo_free(x->data[i]);
+
+    return 0;
+}
+
+
+// in-memory driver: selection is always up to date and complete
+bool neo_fetch(lua_State* L, int ix, int sel, int flags, neo_Reader fn)
+{
+    (void)flags;    // unused
+    neo_X* x = neo_x(L);
+    if (x != NULL && fn != NULL && x->cb[sel] > 0)
+        fn(L, ix, x->data[sel] + 1 + sizeof("utf-8"), x->cb[sel], x->data[sel][0]);
+    return false;
+}
+
+
+// in-memory driver: take new selection data
+void neo_take(lua_State* L, neo_X* x, bool offer, int sel, uint8_t* data, size_t cb)
+{
+    (void)L;        // unused
+    (void)offer;    // unused
+    neo_free(x->data[sel]);
+    x->data[sel] = data;
+    x->cb[sel] = (data != NULL) ? cb : 0;
+}
+
+
+// in-memory driver: get referenced selection data
+uint8_t* neo_peek(neo_X* x, int sel, size_t* pcb)
+{
+    *pcb = x->cb[sel];
+    return neo_ref(x->data[sel]);
+}
+
+
+// in-memory driver: no limit
+bool neo_truncated(neo_X* x, int sel)
+{
+    (void)x;    // unused
+    (void)sel;  // unused
+    return false;
+}
+
+
+// in-memory driver: selection is always ready
+bool neo_request(lua_State* L, int sel)
+{
+    (void)L;    // unused
+    (void)sel;  // unused
+    return true;
+}
+
+
+// in-memory driver: no counters
+void neo_count(neo_X* x, lua_State* L)
+{
+    (void)x;    // unused
+    (void)L;    // unused
+}
+
+
+// generate synthetic corpus of about cb octets
+static void make_corpus(corpus* c, const char* name, size_t cb)
+{
+    static const char* const cjk = "中文字符测试漢字かなカナ한국어";
+    static const char* const emoji = "😀😃😄😁😆😅🤣😂🙂🙃😉😊😇🥰";
+    uint32_t seed = 2463534242;
+#define RAND()  (seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5)
+
+    // a million lines are 2MB at least
+    c->name = name;
+    c->ptr = malloc((cb > 2000000 ? cb : 2000000) + 16);
+    size_t off = 0;
+
+    if (strcmp(name, "cjk") == 0 || strcmp(name, "emoji") == 0) {
+        // lines of 3 or 4 octets characters
+        const char* src = (*name == 'c') ? cjk : emoji;
+        size_t len = strlen(src);
+        while (off + len + 1 <= cb) {
+            size_t n = (RAND() % len + 1) / 12 * 12;
+            memcpy(c->ptr + off, src, n);
+            off += n;
+            c->ptr[off++] = 10;
+        }
+    } else if (strcmp(name, "huge_line") == 0) {
+        // single line w/o LF
+        while (off < cb)
+            c->ptr[off++] = 'a' + RAND() % 26;
+    } else if (strcmp(name, "tiny_lines") == 0) {
+        // a million lines
+        for (size_t i = 0; i < 1000000; ++i) {
+            c->ptr[off++] = 'a' + RAND() % 26;
+            c->ptr[off++] = 10;
+        }
+    } else {
+        // ASCII lines (LF or CRLF)
+        bool crlf = (strcmp(name, "crlf") == 0);
+        while (off + 82 <= cb) {
+            size_t n = RAND() % 80;
+            for (size_t i = 0; i < n; ++i)
+                c->ptr[off++] = ' ' + RAND() % 95;
+            if (crlf)
+                c->ptr[off++] = 13;
+            c->ptr[off++] = 10;
+        }
+        if (strcmp(name, "garbage") == 0) {
+            // trailing NUL and bad octets
+            memcpy(c->ptr + off, "\0\xff\xfe\x80garbage", 12);
+            off += 12;
+        }
+    }
+#undef RAND
+
+    c->cb = off;
+    size_t* lf = NULL;
+    neo_scan(c->ptr, c->cb, &lf, &c->lines);
+    free(lf);
+    ++c->lines;
+}
+
+
+// monotonic time in seconds
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+
+// qsort callback
+static int cmp_double(const void* p1, const void* p2)
+{
+    double d1 = *(const double*)p1, d2 = *(const double*)p2;
+    return (d1 > d2) - (d1 < d2);
+}
+
+
+// driver[method](...)
+static void call_driver(lua_State* L, const char* method, int nargs, int nresults)
+{
+    lua_getglobal(L, "driver");
+    lua_getfield(L, -1, method);
+    lua_replace(L, -2);
+    lua_insert(L, -1 - nargs);
+    lua_call(L, nargs, nresults);
+}
+
+
+// neo_split(text)
+static void op_split(lua_State* L, corpus* c)
+{
+    lua_createtable(L, 2, 0);
+    neo_split(L, -1, c->ptr, c->cb, MAUTO);
+}
+
+
+// neo_join_buf(lines) into new buffer
+static void op_join(lua_State* L, corpus* c)
+{
+    (void)c;    // unused
+    lua_getglobal(L, "lines");
+    lua_rawgeti(L, -1, 1);
+    size_t cb = neo_join_buf(L, -1, "\n", NULL);
+    void* buf = malloc(cb);
+    neo_join_buf(L, -1, "\n", buf);
+    free(buf);
+}
+
+
+// driver.get("+")
+static void op_get(lua_State* L, corpus* c)
+{
+    (void)c;    // unused
+    lua_pushliteral(L, "+");
+    call_driver(L, "get", 1, 1);
+}
+
+
+// driver.get_raw("+")
+static void op_get_raw(lua_State* L, corpus* c)
+{
+    (void)c;    // unused
+    lua_pushliteral(L, "+");
+    call_driver(L, "get_raw", 1, 2);
+}
+
+
+// driver.set("+", lines, "v"): join + _VIMENC_TEXT header packing
+static void op_set(lua_State* L, corpus* c)
+{
+    (void)c;    // unused
+    lua_pushliteral(L, "+");
+    lua_getglobal(L, "lines");
+    lua_rawgeti(L, -1, 1);
+    lua_replace(L, -2);
+    lua_pushliteral(L, "v");
+    call_driver(L, "set", 3, 1);
+}
+
+
+// driver.set_raw("+", text, "v"): _VIMENC_TEXT header packing
+static void op_set_raw(lua_State* L, corpus* c)
+{
+    (void)c;    // unused
+    lua_pushliteral(L, "+");
+    lua_getglobal(L, "text");
+    lua_pushliteral(L, "v");
+    call_driver(L, "set_raw", 3, 1);
+}
@@ -1,6 +1,6 @@
 /*
  * neoclip - Neovim clipboard provider
- * Last Change:  2025 Jun 21
+ * Last Change:  2026 Oct 16
  * License:      https://unlicense.org
  * URL:          https://github.com/matveyt/neoclip
  */
@@ -9,6 +9,10 @@
 #include "neoclip.h"
 
 
+// forward prototype
+static void push_type(lua_State* L, int type, bool chars);
+
+
 // lua_CFunction(uv_module) => string
 int neo_id(lua_State* L)
 {
@@ -81,6 +85,39 @@ void neo_join(lua_State* L, int ix, const char* sep)
 }
 
 
+// table concatenation (numeric indices only) into buffer
+// (buf == NULL) => get required size only
+size_t neo_join_buf(lua_State* L, int ix, const char* sep, void* buf)
+{
+    // accept negative index too
+    ix = neo_absindex(L, ix);
+
+    size_t cbsep = strlen(sep);
+    size_t total = 0;
+
+    int n = lua_objlen(L, ix);
+    for (int i = 1; i <= n; ++i) {
+        if (i > 1) {
+            if (buf != NULL)
+                memcpy((char*)buf + total, sep, cbsep);
+            total += cbsep;
+        }
+
+        size_t cb = 0;
+        lua_rawgeti(L, ix, i);
+        const char* ptr = lua_tolstring(L, -1, &cb);
+        if (ptr == NULL)
+            cb = 0;
+        else if (buf != NULL)
+            memcpy((char*)buf + total, ptr, cb);
+        total += cb;
+        lua_pop(L, 1);
+    }
+
+    return total;
+}
+
+
 // split UTF-8 string into lines (LF or CRLF) and save in table [lines, regtype]
 // chop invalid data, e.g. trailing zero in Windows Clipboard
 void neo_split(lua_State* L, int ix, const void* data, size_t cb, int type)
@@ -93,19 +130,111 @@ void neo_split(lua_State* L, int ix, const void* data, size_t cb, int type)
     if (data == NULL || cb < 1)
         return;
 
-    // pb points to start of line
-    const uint8_t* pb = data;
-    // off + rest = size of remaining text
-    size_t off = 0, rest = cb;
-    // i is Lua table index (one-based)
-    int i = 1;
-    // state: -1 after CR; 0 normal; 1, 2, 3 skip continuation octets
-    int state = 0;
+    // pb points to start of text
+    const char* pb = data;
+    // lf is array of LF offsets
+    size_t* lf = NULL;
+    size_t count = 0;
+    // off is start of line
+    size_t off = 0;
+
+    // find valid text size and all line breaks
+    cb = neo_scan(data, cb, &lf, &count);
 
     // lines table
-    lua_newtable(L);
+    lua_createtable(L, (int)(count + 1), 0);
+
+    for (size_t i = 0; i < count; ++i) {
+        // push current line w/o CR
+        size_t len = lf[i] - off;
+        lua_pushlstring(L, pb + off, len - (len > 0 && pb[lf[i] - 1] == 13));
+        lua_rawseti(L, -2, (int)(i + 1));
+        off = lf[i] + 1;
+    }
+    free(lf);
+
+    // push last string w/o invalid rest
+    size_t len = cb - off;
+    bool cr = (len > 0 && pb[cb - 1] == 13);
+    lua_pushlstring(L, pb + off, len - cr);
+    lua_rawseti(L, -2, (int)(count + 1));
+
+    // save result
+    lua_rawseti(L, ix, 1);
+    push_type(L, type, len > 0 && !cr);
+    lua_rawseti(L, ix, 2);
+}
+
 
-    do {
+// save UTF-8 string as is in table [string, regtype]
+// chop invalid data, e.g. trailing zero in Windows Clipboard
+void neo_raw(lua_State* L, int ix, const void* data, size_t cb, int type)
+{
+    // accept negative index too
+    ix = neo_absindex(L, ix);
+
+    // validate input
+    luaL_checktype(L, ix, LUA_TTABLE);
+    if (data == NULL || cb < 1)
+        return;
+
+    // no LF index required
+    const char* pb = data;
+    cb = neo_scan(data, cb, NULL, NULL);
+
+    // save result
+    lua_pushlstring(L, pb, cb);
+    lua_rawseti(L, ix, 1);
+    push_type(L, type, cb > 0 && pb[cb - 1] != 10 && pb[cb - 1] != 13);
+    lua_rawseti(L, ix, 2);
+}
+
+
+// push regtype string
+// (type == MAUTO) => charwise if last line is not empty and not CR-terminated
+static void push_type(lua_State* L, int type, bool chars)
+{
+    lua_pushlstring(L, type == MCHAR ? "v" : type == MLINE ? "V" :
+        type == MBLOCK ? "\026" : chars ? "v" : "V", sizeof(char));
+}
+
+
+// LF index under construction
+typedef struct {
+    size_t* lf;         // LF offsets
+    size_t count;       // used items
+    size_t size;        // allocated items
+} lf_index;
+
+
+// reserve space for extra items
+// (pi == NULL) => no index required
+static bool lf_reserve(lf_index* pi, size_t extra)
+{
+    if (pi == NULL || pi->size - pi->count >= extra)
+        return true;
+
+    size_t size = pi->size ? pi->size : 64;
+    while (size - pi->count < extra)
+        size *= 2;
+    void* ptr = realloc(pi->lf, size * sizeof(size_t));
+    if (ptr == NULL)
+        return false;
+    pi->lf = ptr;
+    pi->size = size;
+
+    return true;
+}
+
+
+// scalar kernel: scan from off upto cb, (*pstate > 0) => skip continuation octet(s)
+// returns valid text size
+static size_t scan_scalar(const uint8_t* pb, size_t off, size_t cb, int* pstate,
+    lf_index* pi)
+{
+    int state = *pstate;
+
+    for (; off < cb; ++off) {
         int c = pb[off];        // get next octet
 
         if (state > 0) {        // skip continuation octet(s)
@@ -114,18 +243,13 @@ void neo_split(lua_State* L, int ix, const void* data, size_t cb, int type)
             --state;
         } else if (c == 0) {    // NUL
             break;
-        } else if (c == 10) {   // LF or CRLF
-            // push current line
-            lua_pushlstring(L, (const char*)pb, off - (state < 0));
-            lua_rawseti(L, -2, i++);
-            // adjust pb and off
-            pb += off + 1;
-            off = state = 0;
-            continue;           // don't increment off
-        } else if (c == 13) {   // have CR
-            state = -1;
+        } else if (c == 10) {   // LF
+            if (!lf_reserve(pi, 1))
+                break;          // out of memory
+            if (pi != NULL)
+                pi->lf[pi->count++] = off;
         } else if (c < 0x80) {  // 7 bits code
-            state = 0;
+            /*nothing*/;
         } else if (c < 0xc0) {  // unexpected continuation octet
             break;
         } else if (c < 0xe0) {  // 11 bits code
@@ -136,19 +260,176 @@ void neo_split(lua_State* L, int ix, const void* data, size_t cb, int type)
             state = 3;
         } else  // bad octet
             break;
+    }
 
-        ++off;
-    } while (--rest);
+    *pstate = state;
+    return off;
+}
 
-    // push last string w/o invalid rest
-    lua_pushlstring(L, (const char*)pb, off - (state < 0));
-    lua_rawseti(L, -2, i);
 
-    // save result
-    lua_rawseti(L, ix, 1);
-    lua_pushlstring(L, type == MCHAR ? "v" : type == MLINE ? "V" :
-        type == MBLOCK ? "\026" : (state >= 0 && off > 0) ? "v" : "V", sizeof(char));
-    lua_rawseti(L, ix, 2);
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+
+// 32 octets classified into bit masks
+typedef struct {
+    uint32_t high;      // octet >= 0x80
+    uint32_t c0;        // octet >= 0xc0
+    uint32_t e0;        // octet >= 0xe0
+    uint32_t f0;        // octet >= 0xf0
+    uint32_t f8;        // octet >= 0xf8
+    uint32_t nul;       // octet == NUL
+    uint32_t lf;        // octet == LF
+} scan_block;
+
+
+// validate classified block and index its line breaks
+// *carry is continuation octets mask for the next block
+// (false) => use scalar kernel to find exact stop position
+static inline bool scan_masks(const scan_block* b, size_t base, uint64_t* carry,
+    lf_index* pi)
+{
+    if (b->nul != 0 || !lf_reserve(pi, 32))
+        return false;
+
+    if ((b->high | *carry) != 0) {
+        // leading octets of 11, 16 and 21 bits code
+        uint64_t l2 = b->c0 & ~b->e0;
+        uint64_t l3 = b->e0 & ~b->f0;
+        uint64_t l4 = b->f0 & ~b->f8;
+        // where continuation octets must be
+        uint64_t cont = *carry | (l2 | l3 | l4) << 1 | (l3 | l4) << 2 | l4 << 3;
+        if (b->f8 != 0 || (uint32_t)cont != (b->high & ~b->c0))
+            return false;
+        *carry = cont >> 32;
+    }
+
+    if (pi != NULL)
+        for (uint32_t m = b->lf; m != 0; m &= m - 1)
+            pi->lf[pi->count++] = base + __builtin_ctz(m);
+
+    return true;
+}
+
+
+// SSE2 helpers
+static inline uint32_t sse2_gt(__m128i v, char k)
+{
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi8(v, _mm_set1_epi8(k)));
+}
+static inline uint32_t sse2_eq(__m128i v, char k)
+{
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(k)));
+}
+
+
+// SSE2 kernel (x86_64 baseline)
+static size_t scan_sse2(const uint8_t* pb, size_t cb, int* pstate, lf_index* pi)
+{
+    size_t off = 0;
+    uint64_t carry = (1u << *pstate) - 1;
+
+    for (; cb - off >= 32; off += 32) {
+        scan_block b = {0};
+        for (int s = 0; s < 32; s += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(pb + off + s));
+            uint32_t h = (uint32_t)_mm_movemask_epi8(v);
+            b.high |= h << s;
+            b.c0 |= (sse2_gt(v, -65) & h) << s;
+            b.e0 |= (sse2_gt(v, -33) & h) << s;
+            b.f0 |= (sse2_gt(v, -17) & h) << s;
+            b.f8 |= (sse2_gt(v, -9) & h) << s;
+            b.nul |= sse2_eq(v, 0) << s;
+            b.lf |= sse2_eq(v, 10) << s;
+        }
+        if (!scan_masks(&b, off, &carry, pi))
+            break;
+    }
+
+    *pstate = __builtin_popcountll(carry);
+    return scan_scalar(pb, off, cb, pstate, pi);
+}
+
+
+// AVX2 helpers
+__attribute__((target("avx2")))
+static inline uint32_t avx2_gt(__m256i v, char k)
+{
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(k)));
+}
+__attribute__((target("avx2")))
+static inline uint32_t avx2_eq(__m256i v, char k)
+{
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(k)));
+}
+
+
+// AVX2 kernel (runtime dispatch)
+__attribute__((target("avx2")))
+static size_t scan_avx2(const uint8_t* pb, size_t cb, int* pstate, lf_index* pi)
+{
+    size_t off = 0;
+    uint64_t carry = (1u << *pstate) - 1;
+
+    for (; cb - off >= 32; off += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(pb + off));
+        uint32_t h = (uint32_t)_mm256_movemask_epi8(v);
+        scan_block b = {
+            .high = h,
+            .c0 = avx2_gt(v, -65) & h,
+            .e0 = avx2_gt(v, -33) & h,
+            .f0 = avx2_gt(v, -17) & h,
+            .f8 = avx2_gt(v, -9) & h,
+            .nul = avx2_eq(v, 0),
+            .lf = avx2_eq(v, 10),
+        };
+        if (!scan_masks(&b, off, &carry, pi))
+            break;
+    }
+
+    *pstate = __builtin_popcountll(carry);
+    return scan_scalar(pb, off, cb, pstate, pi);
+}
+#endif // __GNUC__ && __x86_64__
+
+
+// run best kernel available
+static size_t scan_any(const void* data, size_t cb, int* pstate, lf_index* pi)
+{
+#if defined(__GNUC__) && defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2"))
+        return scan_avx2(data, cb, pstate, pi);
+    return scan_sse2(data, cb, pstate, pi);
+#else
+    return scan_scalar(data, 0, cb, pstate, pi);
+#endif // __GNUC__ && __x86_64__
+}
+
+
+// validate UTF-8 string and find all LF offsets
+// chop invalid data (NUL, bad or unexpected octet, out of memory)
+// returns valid text size; *plf must be free()'d
+// (plf == NULL) => validate only
+size_t neo_scan(const void* data, size_t cb, size_t** plf, size_t* pcount)
+{
+    lf_index index = {0};
+    int state = 0;
+
+    cb = scan_any(data, cb, &state, (plf != NULL) ? &index : NULL);
+
+    if (plf != NULL) {
+        *plf = index.lf;
+        *pcount = index.count;
+    }
+    return cb;
+}
+
+
+// validate next chunk of UTF-8 string
+// *pstate is count of continuation octets expected (zero at start)
+// returns valid chunk size
+size_t neo_valid(const void* data, size_t cb, int* pstate)
+{
+    return scan_any(data, cb, pstate, NULL);
 }
 
 
@@ -1,12 +1,18 @@
 /*
  * neoclip - Neovim clipboard provider
- * Last Change:  2025 Jun 21
+ * Last Change:  2026 Oct 16
  * License:      https://unlicense.org
  * URL:          https://github.com/matveyt/neoclip
  */
 
 
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif // __linux__
 #include "neo_wayland.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
 
 #if defined(WITH_THREADS)
@@ -22,10 +28,12 @@ static const char* const mime[] = {
     [1] = "_VIM_TEXT",
     "text/plain;charset=utf-8",
     "text/plain",
-    "UTF8_STRING",
+    [4] = "UTF8_STRING",
     "STRING",
     "TEXT",
 };
+// private mime type to recognize our own offers
+static char own_mime[64];
 
 
 // Wayland listeners
@@ -71,6 +79,12 @@ static inline int listen_to(void* object, int i, void* data)
 // init state and start thread
 int neo_start(lua_State* L)
 {
+    // uv_share.opts = opts
+    if (lua_istable(L, 1)) {
+        lua_pushvalue(L, 1);
+        lua_setfield(L, uv_share, "opts");
+    }
+
     neo_X* x = neo_x(L);
     if (x == NULL) {
         // create new state
@@ -115,7 +129,45 @@ int neo_start(lua_State* L)
         for (size_t i = 0; i < sel_total; ++i) {
             x->data[i] = NULL;
             x->cb[i] = 0;
+            x->recv[i].offer = NULL;
+            x->recv[i].fd = -1;
+            x->recv[i].data = NULL;
+            x->f_rdy[i] = true;
+            x->f_foreign[i] = false;
+            x->f_trunc[i] = false;
+            x->f_full[i] = false;
+            x->used[i] = 0;
+#if defined(WITH_THREADS)
+            pthread_cond_init(&x->c_rdy[i], NULL);
+#endif // WITH_THREADS
+        }
+        for (size_t i = 0; i < SEND_MAX; ++i) {
+            x->send[i].fd = -1;
+            x->send[i].data = NULL;
         }
+        x->eager = neo_opt(L, "eager");
+        x->trim = neo_optint(L, "trim", 0) * 1000;
+        x->limit = neo_optint(L, "limit", 0);
+        neo_memfd_min = neo_optint(L, "memfd", MEMFD_MIN);
+        x->echo = 0;
+
+        // random token marks own offers: PID is not unique across sandboxes
+        uint64_t token = 0;
+        int fd = open("/dev/urandom", O_RDONLY);
+        if (fd >= 0) {
+            if (read(fd, &token, sizeof(token)) != sizeof(token))
+                token = 0;
+            close(fd);
+        }
+        if (token == 0) {
+            // no urandom: start time and state address
+            struct timespec t = { 0 };
+            clock_gettime(CLOCK_REALTIME, &t);
+            token = ((uint64_t)t.tv_sec * 1000000000 + t.tv_nsec) ^ (uintptr_t)x
+                ^ ((uint64_t)getpid() << 32);
+        }
+        snprintf(own_mime, sizeof(own_mime), "application/x-neoclip-%016llx",
+            (unsigned long long)token);
 
         // metatable for state
         luaL_newmetatable(L, lua_tostring(L, uv_module));
@@ -125,9 +177,11 @@ int neo_start(lua_State* L)
 
         // uv_share.x = x
         lua_setfield(L, uv_share, "x");
+        neo_ffi_x = x;
 
 #if defined(WITH_LUV)
         // start polling display
+        x->L = NULL;
         lua_getglobal(L, "vim");                // vim.uv or vim.loop => stack
         lua_getfield(L, -1, "uv");
         if (lua_isnil(L, -1)) {
@@ -136,39 +190,56 @@ int neo_start(lua_State* L)
         }
         lua_replace(L, -2);
 
-        // local prepare = uv.new_prepare()
-        lua_getfield(L, -1, "new_prepare");
-        lua_call(L, 0, 1);                      // prepare => stack
-        // uv.prepare_start(prepare, cb_prepare)
-        lua_getfield(L, -2, "prepare_start");
-        lua_pushvalue(L, -2);
-        neo_pushcfunction(L, cb_prepare);
-        lua_call(L, 2, 0);
+        // uv_share.timer = uv.new_timer()
+        lua_getfield(L, -1, "new_timer");
+        lua_call(L, 0, 1);
+        lua_setfield(L, uv_share, "timer");
+        x->timer = 0;
+        x->polls = x->timers = 0;
 
         // local poll = uv.new_poll(wl_display_get_fd(x->d))
-        lua_getfield(L, -2, "new_poll");
+        lua_getfield(L, -1, "new_poll");
         lua_pushinteger(L, wl_display_get_fd(x->d));
         lua_call(L, 1, 1);                      // poll => stack
-        // uv.poll_start(poll, "rw", cb_poll)
-        lua_getfield(L, -3, "poll_start");
+        // uv.poll_start(poll, "r", cb_poll)
+        x->f_write = false;
+        lua_getfield(L, -2, "poll_start");
         lua_pushvalue(L, -2);
-        lua_pushliteral(L, "rw");
+        lua_pushliteral(L, "r");
         neo_pushcfunction(L, cb_poll);
         lua_call(L, 3, 0);
 
         // uv_share.poll = poll
         lua_setfield(L, uv_share, "poll");      // poll <= stack
-        // uv_share.prepare = prepare
-        lua_setfield(L, uv_share, "prepare");   // prepare <= stack
         // uv_share.uv = vim.uv or vim.loop
         lua_setfield(L, uv_share, "uv");        // vim.uv or vim.loop <= stack
+        settle(x, L);
 #endif // WITH_LUV
 
 #if defined(WITH_THREADS)
+        // command pipe: non-blocking read end
+        if (pipe(x->fd) < 0) {
+            ext_data_control_device_v1_destroy(x->dcd);
+            ext_data_control_manager_v1_destroy(x->dcm);
+            wl_seat_release(x->seat);
+            wl_display_disconnect(x->d);
+            lua_pushliteral(L, "pipe failed");
+            return lua_error(L);
+        }
+        fcntl(x->fd[0], F_SETFL, O_NONBLOCK);
+        fcntl(x->fd[0], F_SETFD, FD_CLOEXEC);
+        fcntl(x->fd[1], F_SETFD, FD_CLOEXEC);
+
         // start thread
         pthread_mutex_init(&x->lock, NULL);
         pthread_create(&x->tid, NULL, thread_main, x);
 #endif // WITH_THREADS
+    } else if (lua_istable(L, 1) && neo_lock(x)) {
+        // update options
+        x->eager = neo_opt(L, "eager");
+        x->trim = neo_optint(L, "trim", 0) * 1000;
+        x->limit = neo_optint(L, "limit", 0);
+        neo_unlock(x);
     }
 
     lua_pushnil(L);
@@ -180,8 +251,12 @@ int neo_start(lua_State* L)
 int neo__gc(lua_State* L)
 {
     neo_X* x = (neo_X*)neo_checkud(L, 1);
+    if (neo_ffi_x == x)
+        neo_ffi_x = NULL;
 
 #if defined(WITH_LUV)
+    // transfers are closed below
+    x->L = L;
     lua_getfield(L, uv_share, "uv");    // uv or loop => stack
     // uv.poll_stop(uv_share.poll)
     lua_getfield(L, -1, "poll_stop");
@@ -199,20 +274,20 @@ int neo__gc(lua_State* L)
         lua_setfield(L, uv_share, "poll");
     }
 
-    // uv.prepare_stop(prepare)
-    lua_getfield(L, -1, "prepare_stop");
-    lua_getfield(L, uv_share, "prepare");
+    // uv.timer_stop(uv_share.timer)
+    lua_getfield(L, -1, "timer_stop");
+    lua_getfield(L, uv_share, "timer");
     if (lua_isnil(L, -1)) {
         lua_pop(L, 2);
     } else {
         lua_call(L, 1, 0);
-        // uv.close(prepare)
+        // uv.close(timer)
         lua_getfield(L, -1, "close");
-        lua_getfield(L, uv_share, "prepare");
+        lua_getfield(L, uv_share, "timer");
         lua_call(L, 1, 0);
-        // uv_share.prepare = nil
+        // uv_share.timer = nil
         lua_pushnil(L);
-        lua_setfield(L, uv_share, "prepare");
+        lua_setfield(L, uv_share, "timer");
     }
 #endif // WITH_LUV
 
@@ -220,11 +295,21 @@ int neo__gc(lua_State* L)
     pthread_kill(x->tid, SIGTERM);
     pthread_join(x->tid, NULL);
     pthread_mutex_destroy(&x->lock);
+    close(x->fd[0]);
+    close(x->fd[1]);
 #endif // WITH_THREADS
 
     // clear data
-    for (size_t i = 0; i < sel_total; ++i)
-        free(x->data[i]);
+    for (size_t i = 0; i < SEND_MAX; ++i)
+        if (x->send[i].fd >= 0)
+            send_end(x, &x->send[i]);
+    for (size_t i = 0; i < sel_total; ++i) {
+        recv_stop(x, i);
+        neo_free(x->data[i]);
+#if defined(WITH_THREADS)
+        pthread_cond_destroy(&x->c_rdy[i]);
+#endif // WITH_THREADS
+    }
     ext_data_control_device_v1_destroy(x->dcd);
     ext_data_control_manager_v1_destroy(x->dcm);
     wl_seat_release(x->seat);
@@ -235,39 +320,120 @@ int neo__gc(lua_State* L)
 
 
 // fetch new selection
-void neo_fetch(lua_State* L, int ix, int sel)
+// (fetch_full) => read offer again if it was truncated
+// (fetch_sent) => no matter, reading offer twice is a no-op (see recv_fetch)
+// (return true) => text is truncated (see recv_pipe)
+bool neo_fetch(lua_State* L, int ix, int sel, int flags, neo_Reader fn)
 {
+    bool trunc = false;
+
     neo_X* x = neo_x(L);
     if (x != NULL && neo_lock(x)) {
+        if ((flags & fetch_full) && x->f_trunc[sel]) {
+            // ignore limit once
+            x->f_full[sel] = true;
+            x->f_rdy[sel] = false;
+        }
+
         // ext_data_control_device should've informed us of a new selection
-        if (x->cb[sel] > 0)
-            neo_split(L, ix, x->data[sel] + 1 + sizeof("utf-8"), x->cb[sel],
-                x->data[sel][0]);
+        if (!x->f_rdy[sel]) {
+            // offer is pending or being read
+            x->till[sel] = now_ms() + RECV_TIMEOUT;
+#if defined(WITH_THREADS)
+            post_command(x, sel);
 
-        // release lock
+            // wait until deadline (transfer progress extends it)
+            for (uint64_t now; !x->f_rdy[sel] && (now = now_ms()) < x->till[sel]; ) {
+                struct timespec t;
+                if (clock_gettime(CLOCK_REALTIME, &t) < 0)
+                    break;
+                uint64_t ms = x->till[sel] - now;
+                t.tv_sec += ms / 1000;
+                t.tv_nsec += (ms % 1000) * 1000000;
+                if (t.tv_nsec >= 1000000000) {
+                    ++t.tv_sec;
+                    t.tv_nsec -= 1000000000;
+                }
+                pthread_cond_timedwait(&x->c_rdy[sel], &x->lock, &t);
+            }
+#endif // WITH_THREADS
+
+#if defined(WITH_LUV)
+            lua_State* L0 = x->L;
+            x->L = L;
+            recv_fetch(x, sel);
+            settle(x, L);
+            modal_loop(L, &x->f_rdy[sel], &x->till[sel]);
+            x->L = L0;
+#endif // WITH_LUV
+        }
+
+        // take snapshot and release lock
+        x->used[sel] = now_ms();
+        size_t cb = x->cb[sel];
+        uint8_t* data = x->f_rdy[sel] ? neo_ref(x->data[sel]) : NULL;
+        trunc = (data != NULL && cb > 0 && x->f_trunc[sel]);
         neo_unlock(x);
+
+        // split selection into t[ix]
+        if (fn != NULL && data != NULL && cb > 0)
+            fn(L, ix, data + 1 + sizeof("utf-8"), cb, data[0]);
+        neo_free(data);
     }
+
+    return trunc;
 }
 
 
-// own new selection
-// (cb == 0) => empty selection
-void neo_own(neo_X* x, bool offer, int sel, const void* ptr, size_t cb, int type)
+// start fetching selection without waiting (see neo_get_async)
+// (return true) => data is ready
+bool neo_request(lua_State* L, int sel)
 {
-    if (neo_lock(x)) {
-        // _VIMENC_TEXT: type 'encoding' NUL text
-        cb = alloc_data(x, sel, cb);
-        if (cb > 0) {
-            x->data[sel][0] = type;
-            memcpy(x->data[sel] + 1, "utf-8", sizeof("utf-8"));
-            memcpy(x->data[sel] + 1 + sizeof("utf-8"), ptr, cb);
+    neo_X* x = neo_x(L);
+    bool ready = true;
+
+    if (x != NULL && neo_lock(x)) {
+        if (!x->f_rdy[sel]) {
+            // offer is pending or being read
+            x->till[sel] = now_ms() + RECV_TIMEOUT;
+#if defined(WITH_THREADS)
+            post_command(x, sel);
+#endif // WITH_THREADS
+#if defined(WITH_LUV)
+            lua_State* L0 = x->L;
+            x->L = L;
+            recv_fetch(x, sel);
+            settle(x, L);
+            x->L = L0;
+#endif // WITH_LUV
+            ready = false;
         }
 
+        neo_unlock(x);
+    }
+
+    return ready;
+}
+
+
+// take new selection data (see neo_alloc)
+// (data == NULL) => empty selection
+// (L == NULL) => no Lua frame, e.g. LuaJIT FFI
+void neo_take(lua_State* L, neo_X* x, bool offer, int sel, uint8_t* data, size_t cb)
+{
+    if (neo_lock(x)) {
+        set_data(x, sel, data, cb);
+        x->f_foreign[sel] = (!offer && data != NULL);
+        if (offer)
+            x->f_trunc[sel] = x->f_full[sel] = false;
+        neo_signal(x, sel);
+
         if (offer) {
             // offer our selection
             struct ext_data_control_source_v1* dcs = create_data_source(x);
             for (size_t i = 0; i < _countof(mime); ++i)
                 ext_data_control_source_v1_offer(dcs, mime[i]);
+            ext_data_control_source_v1_offer(dcs, own_mime);
             switch (sel) {
             case sel_prim:
                 listen_to(dcs, INDEX(source_prim), x);
@@ -278,25 +444,92 @@ void neo_own(neo_X* x, bool offer, int sel, const void* ptr, size_t cb, int type
                 ext_data_control_device_v1_set_selection(x->dcd, dcs);
             break;
             }
-            wl_display_flush(x->d);
+            // source events are dispatched by the polling thread or cb_poll
 #if defined(WITH_LUV)
-            // dispatch in the polling thread only!
-            wl_display_roundtrip(x->d);
+            flush_event(x, L);
+#else
+            (void)L;    // unused
+            wl_display_flush(x->d);
 #endif // WITH_LUV
         }
 
+        neo_unlock(x);
+    } else
+        neo_free(data);
+}
+
+
+// get referenced selection data (see neo_ref)
+uint8_t* neo_peek(neo_X* x, int sel, size_t* pcb)
+{
+    uint8_t* data = NULL;
+
+    *pcb = 0;
+    if (neo_lock(x)) {
+        data = neo_ref(x->data[sel]);
+        *pcb = x->cb[sel];
+        x->used[sel] = now_ms();
+        neo_unlock(x);
+    }
+
+    return data;
+}
+
+
+// is selection data cut at limit? (see recv_pipe)
+bool neo_truncated(neo_X* x, int sel)
+{
+    bool trunc = false;
+
+    if (neo_lock(x)) {
+        trunc = (x->cb[sel] > 0 && x->f_trunc[sel]);
+        neo_unlock(x);
+    }
+
+    return trunc;
+}
+
+
+// set counters into table on stack top
+void neo_count(neo_X* x, lua_State* L)
+{
+    if (neo_lock(x)) {
+        lua_pushinteger(L, x->echo);
+        lua_setfield(L, -2, "echo");
+#if defined(WITH_LUV)
+        lua_pushinteger(L, x->polls);
+        lua_setfield(L, -2, "polls");
+        lua_pushinteger(L, x->timers);
+        lua_setfield(L, -2, "timers");
+#endif // WITH_LUV
         neo_unlock(x);
     }
 }
 
 
 #if defined(WITH_LUV)
-// uv_prepare_t callback
-static int cb_prepare(lua_State* L)
+// uv_poll_t callback: drain all events
+static int cb_poll(lua_State* L)
 {
     neo_X* x = neo_x(L);
-    if (x != NULL)
-        prepare_event(x->d);
+    if (x != NULL && lua_isnil(L, 1)) {
+        ++x->polls;
+        // listeners may start or stop transfers
+        lua_State* L0 = x->L;
+        x->L = L;
+        // socket is readable: won't block
+        bool valid = true;
+        if (strchr(lua_tostring(L, 2), 'r') != NULL) {
+            while (wl_display_prepare_read(x->d) != 0)
+                wl_display_dispatch_pending(x->d);
+            valid = (wl_display_read_events(x->d) >= 0);
+            if (valid)
+                wl_display_dispatch_pending(x->d);
+        }
+        if (valid)
+            settle(x, L);
+        x->L = L0;
+    }
 
     return 0;
 }
@@ -304,13 +537,116 @@ static int cb_prepare(lua_State* L)
 
 
 #if defined(WITH_LUV)
-// uv_poll_t callback
-static int cb_poll(lua_State* L)
+// uv_timer_t callback: drop stalled transfers
+static int cb_timer(lua_State* L)
+{
+    neo_X* x = neo_x(L);
+    if (x != NULL) {
+        ++x->timers;
+        x->timer = 0;
+        lua_State* L0 = x->L;
+        x->L = L;
+        settle(x, L);
+        x->L = L0;
+    }
+
+    return 0;
+}
+#endif // WITH_LUV
+
+
+#if defined(WITH_LUV)
+// flush requests; poll for "w" event only while output is pending
+static void settle(neo_X* x, lua_State* L)
+{
+    flush_event(x, L);
+
+    // (re)arm timer for the nearest deadline
+    int timeout = expire(x);
+    uint64_t till = (timeout < 0) ? 0 : now_ms() + timeout;
+    if (till != x->timer) {
+        x->timer = till;
+
+        lua_getfield(L, uv_share, "uv");    // uv or loop => stack
+        if (timeout < 0) {
+            // uv.timer_stop(uv_share.timer)
+            lua_getfield(L, -1, "timer_stop");
+            lua_getfield(L, uv_share, "timer");
+            lua_call(L, 1, 0);
+        } else {
+            // uv.timer_start(uv_share.timer, timeout, 0, cb_timer)
+            lua_getfield(L, -1, "timer_start");
+            lua_getfield(L, uv_share, "timer");
+            lua_pushinteger(L, timeout);
+            lua_pushinteger(L, 0);
+            neo_pushcfunction(L, cb_timer);
+            lua_call(L, 4, 0);
+        }
+        lua_pop(L, 1);                      // uv or loop <= stack
+    }
+}
+#endif // WITH_LUV
+
+
+#if defined(WITH_LUV)
+// flush display; poll for "w" event only while wl_display_flush would block
+// (L == NULL) => no Lua frame: poll is changed by next settle
+static void flush_event(neo_X* x, lua_State* L)
+{
+    bool f_write = (wl_display_flush(x->d) < 0 && errno == EAGAIN);
+
+    if (L != NULL && f_write != x->f_write) {
+        x->f_write = f_write;
+
+        // uv.poll_start(uv_share.poll, events, cb_poll)
+        lua_getfield(L, uv_share, "uv");
+        lua_getfield(L, -1, "poll_start");
+        lua_getfield(L, uv_share, "poll");
+        if (f_write)
+            lua_pushliteral(L, "rw");
+        else
+            lua_pushliteral(L, "r");
+        neo_pushcfunction(L, cb_poll);
+        lua_call(L, 3, 0);
+        lua_pop(L, 1);
+    }
+}
+#endif // WITH_LUV
+
+
+#if defined(WITH_LUV)
+// uv_poll_t callback for selection pipes
+static int cb_pipe(lua_State* L)
+{
+    neo_X* x = neo_x(L);
+    if (x != NULL) {
+        lua_State* L0 = x->L;
+        x->L = L;
+        for (size_t i = 0; i < sel_total; ++i)
+            recv_pipe(x, i);
+        settle(x, L);
+        x->L = L0;
+    }
+
+    return 0;
+}
+#endif // WITH_LUV
+
+
+#if defined(WITH_LUV)
+// uv_poll_t callback for transfers to other clients
+static int cb_send(lua_State* L)
 {
     neo_X* x = neo_x(L);
-    if (x != NULL)
-        dispatch_event(x->d,
-            lua_isnil(L, 1) && strchr(lua_tostring(L, 2), 'r') != NULL);
+    if (x != NULL) {
+        lua_State* L0 = x->L;
+        x->L = L;
+        for (size_t i = 0; i < SEND_MAX; ++i)
+            if (x->send[i].fd >= 0)
+                send_next(x, &x->send[i]);
+        settle(x, L);
+        x->L = L0;
+    }
 
     return 0;
 }
@@ -329,15 +665,26 @@ static void* thread_main(void* X)
     sigaddset(&mask, SIGTERM);
     pthread_sigmask(SIG_BLOCK, &mask, NULL);
 
-    struct pollfd fds[] = {
+    struct pollfd fds[3 + sel_total + SEND_MAX] = {
         { .fd = signalfd(-1, &mask, 0), .events = POLLIN, },
         { .fd = wl_display_get_fd(x->d), .events = POLLIN, },
+        { .fd = x->fd[0], .events = POLLIN, },
     };
 
     do {
         prepare_event(x->d);
 
-        if (poll(fds, _countof(fds), -1) < 0)
+        // also poll selection pipes
+        size_t nfds = 3;
+        for (size_t i = 0; i < sel_total; ++i)
+            if (x->recv[i].fd >= 0)
+                fds[nfds++] = (struct pollfd){ .fd = x->recv[i].fd, .events = POLLIN };
+        size_t nrecv = nfds;
+        for (size_t i = 0; i < SEND_MAX; ++i)
+            if (x->send[i].fd >= 0)
+                fds[nfds++] = (struct pollfd){ .fd = x->send[i].fd, .events = POLLOUT };
+
+        if (poll(fds, nfds, expire(x)) < 0)
             break;
 
         if (fds[0].revents & POLLIN) {
@@ -346,6 +693,20 @@ static void* thread_main(void* X)
             if (cb != sizeof(ssi) || ssi.ssi_signo == SIGINT || ssi.ssi_signo == SIGTERM)
                 break;
         }
+
+        if (fds[2].revents & POLLIN)
+            on_command(x);
+
+        for (size_t i = 3; i < nrecv; ++i)
+            if (fds[i].revents != 0)
+                for (size_t j = 0; j < sel_total; ++j)
+                    if (x->recv[j].fd == fds[i].fd)
+                        recv_pipe(x, j);
+        for (size_t i = nrecv; i < nfds; ++i)
+            if (fds[i].revents != 0)
+                for (size_t j = 0; j < SEND_MAX; ++j)
+                    if (x->send[j].fd == fds[i].fd)
+                        send_next(x, &x->send[j]);
     } while (dispatch_event(x->d, fds[1].revents & POLLIN) >= 0);
 
     close(fds[0].fd);
@@ -355,6 +716,29 @@ static void* thread_main(void* X)
 #endif // WITH_THREADS
 
 
+#if defined(WITH_THREADS)
+// read and execute commands from pipe
+static void on_command(neo_X* x)
+{
+    int sel;
+
+    while (read(x->fd[0], &sel, sizeof(sel)) == sizeof(sel))
+        recv_fetch(x, sel);
+}
+#endif // WITH_THREADS
+
+
+#if defined(WITH_THREADS)
+// ask our thread to read selection
+// Note: pipe writes upto PIPE_BUF are atomic
+static void post_command(neo_X* x, int sel)
+{
+    while (write(x->fd[1], &sel, sizeof(sel)) < 0 && errno == EINTR)
+        /*nothing*/;
+}
+#endif // WITH_THREADS
+
+
 // wl_registry::global
 static void registry_global(void* X, struct wl_registry* registry, uint32_t name,
     const char* interface, uint32_t version)
@@ -429,14 +813,16 @@ static void data_control_offer_offer(void* X, struct ext_data_control_offer_v1*
 {
     (void)X;    // unused
 
-    size_t best_mime = (uintptr_t)ext_data_control_offer_v1_get_user_data(offer);
-    for (size_t i = 0; i < best_mime; ++i) {
+    uintptr_t best_mime = (uintptr_t)ext_data_control_offer_v1_get_user_data(offer);
+    if (strcmp(mime_type, own_mime) == 0)
+        best_mime |= OFFER_OWN;
+    for (size_t i = 0; i < (best_mime & ~OFFER_OWN); ++i) {
         if (strcmp(mime_type, mime[i]) == 0) {
-            best_mime = i;
+            best_mime = i | (best_mime & OFFER_OWN);
             break;
         }
     }
-    ext_data_control_offer_v1_set_user_data(offer, (void*)(uintptr_t)best_mime);
+    ext_data_control_offer_v1_set_user_data(offer, (void*)best_mime);
 }
 
 
@@ -467,26 +853,19 @@ static void data_control_source_cancelled(void* X,
 }
 
 
-// (re-)allocate data buffer for selection
+// replace data buffer for selection
 // Note: caller must acquire neo_lock() first
-static size_t alloc_data(neo_X* x, int sel, size_t cb)
+static void set_data(neo_X* x, int sel, uint8_t* data, size_t cb)
 {
-    if (cb > 0) {
-        void* ptr = realloc(x->data[sel], 1 + sizeof("utf-8") + cb);
-        if (ptr != NULL) {
-            x->data[sel] = ptr;
-            x->cb[sel] = cb;
-        }
-    } else {
-        free(x->data[sel]);
-        x->data[sel] = NULL;
-        x->cb[sel] = 0;
-    }
-
-    return x->cb[sel];
+    neo_free(x->data[sel]);
+    x->data[sel] = data;
+    x->cb[sel] = (data != NULL) ? cb : 0;
+    x->f_foreign[sel] = false;
+    x->used[sel] = now_ms();
 }
 
 
+#if defined(WITH_THREADS)
 // read or cancel wl_display event
 static int dispatch_event(struct wl_display* d, bool valid)
 {
@@ -496,8 +875,10 @@ static int dispatch_event(struct wl_display* d, bool valid)
         wl_display_cancel_read(d);
     return wl_display_dispatch_pending(d);
 }
+#endif // WITH_THREADS
 
 
+#if defined(WITH_THREADS)
 // prepare to read wl_display event
 static int prepare_event(struct wl_display* d)
 {
@@ -505,110 +886,469 @@ static int prepare_event(struct wl_display* d)
         wl_display_dispatch_pending(d);
     return wl_display_flush(d);
 }
+#endif // WITH_THREADS
 
 
 // read selection data from offer
 static void sel_read(neo_X* x, int sel, struct ext_data_control_offer_v1* offer)
 {
     if (offer == NULL) {
-        neo_own(x, false, sel, NULL, 0, 0);
+        recv_stop(x, sel);
+        neo_own(NULL, x, false, sel, NULL, 0, 0);
         return;
     }
 
     size_t best_mime = (uintptr_t)ext_data_control_offer_v1_get_user_data(offer);
-    if (best_mime < _countof(mime)) {
-        size_t cb;
-        uint8_t* ptr = offer_read(x, offer, mime[best_mime], &cb);
-        int type = (cb > 0 && best_mime <= 1) ? ptr[0] : MAUTO;
-
-        void* data = ptr;
-        if (cb == 0) {
-            // nothing to do
-        } else if (best_mime == 0) {
-            // _VIMENC_TEXT
-            if (cb >= 1 + sizeof("utf-8")
-                && memcmp(ptr + 1, "utf-8", sizeof("utf-8")) == 0) {
-                // this is UTF-8
-                data = ptr + 1 + sizeof("utf-8");
-                cb -= 1 + sizeof("utf-8");
-            } else {
-                // Vim must have UTF8_STRING
-                free(ptr);
-                data = ptr = offer_read(x, offer, "UTF8_STRING", &cb);
-            }
-        } else if (best_mime == 1) {
-            // _VIM_TEXT
-            data = ptr + 1;
-            --cb;
+    if (best_mime & OFFER_OWN) {
+        // our own source: data is already there
+        recv_stop(x, sel);
+        ext_data_control_offer_v1_destroy(offer);
+        if (neo_lock(x)) {
+            ++x->echo;
+            neo_signal(x, sel);
+            neo_unlock(x);
+        }
+    } else if (best_mime < _countof(mime)) {
+        bool eager = true;
+        if (neo_lock(x)) {
+            // data is out of date
+            x->f_rdy[sel] = false;
+            eager = x->eager;
+            neo_unlock(x);
+        }
+
+        if (eager) {
+            recv_start(x, sel, offer, best_mime);
+        } else {
+            // keep offer until neo_fetch
+            recv_stop(x, sel);
+            x->recv[sel].offer = offer;
+            x->recv[sel].mime = best_mime;
         }
+    } else
+        ext_data_control_offer_v1_destroy(offer);
+}
+
+
+// start writing selection data to file descriptor
+// the rest is written as pipe gets ready (see send_next)
+static void sel_write(neo_X* x, int sel, const char* mime_type, int fd)
+{
+    size_t cb;
+    uint8_t* data = neo_peek(x, sel, &cb);
+
+    // find free slot
+    neo_Send* s = NULL;
+    for (size_t i = 0; i < SEND_MAX && s == NULL; ++i)
+        if (x->send[i].fd < 0)
+            s = &x->send[i];
+
+    if (data == NULL || s == NULL) {
+        neo_free(data);
+        close(fd);
+        return;
+    }
 
-        neo_own(x, false, sel, data, cb, type);
-        free(ptr);
+    // assume _VIMENC_TEXT
+    s->fd = fd;
+    s->data = data;
+    s->iov[0] = (struct iovec){ .iov_base = data, .iov_len = 0 };
+    s->iov[1] = (struct iovec){ .iov_base = data, .iov_len = 1 + sizeof("utf-8") + cb };
+
+    // not _VIMENC_TEXT?
+    if (strcmp(mime_type, mime[0]) != 0) {
+        // _VIM_TEXT: output type
+        if (strcmp(mime_type, mime[1]) == 0)
+            s->iov[0].iov_len = 1;
+
+        // skip over header
+        s->iov[1].iov_base = data + 1 + sizeof("utf-8");
+        s->iov[1].iov_len = cb;
     }
 
-    ext_data_control_offer_v1_destroy(offer);
+    // output selection
+    size_t off;
+    s->f_splice = (neo_memfd(data, &off) >= 0);
+    s->till = now_ms() + SEND_TIMEOUT;
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    send_next(x, s);
+#if defined(WITH_LUV)
+    if (s->fd >= 0)
+        uv_watch(x->L, s->fd, "w", cb_send);
+#endif // WITH_LUV
 }
 
 
-// write selection data to file descriptor
-static void sel_write(neo_X* x, int sel, const char* mime_type, int fd)
+// start reading offer by pipe
+// data is published upon EOF (see recv_pipe)
+static void recv_start(neo_X* x, int sel, struct ext_data_control_offer_v1* offer,
+    size_t best_mime)
 {
+    neo_Recv* r = &x->recv[sel];
+
+    // abandon previous transfer
+    if (r->offer != offer)
+        recv_stop(x, sel);
+    else
+        recv_close(x, sel);
+
+    // pipe data is stored right into selection buffer
+    r->offer = offer;
+    r->mime = best_mime;
+    if (best_mime == 0)
+        r->base = 0;                    // type 'encoding' NUL text
+    else if (best_mime == 1)
+        r->base = sizeof("utf-8");      // type text
+    else
+        r->base = 1 + sizeof("utf-8");  // text
+    r->pos = r->base;
+    r->size = 0;
+    r->trunc = false;
     if (neo_lock(x)) {
-        // assume _VIMENC_TEXT
-        uint8_t* buf = x->data[sel];
-        size_t cb = 1 + sizeof("utf-8") + x->cb[sel];
-        ssize_t n = 1;
-
-        // not _VIMENC_TEXT?
-        if (strcmp(mime_type, mime[0]) != 0) {
-            // _VIM_TEXT: output type
-            if (strcmp(mime_type, mime[1]) == 0)
-                n = write(fd, buf, 1);
-
-            // skip over header
-            buf += 1 + sizeof("utf-8");
-            cb -= 1 + sizeof("utf-8");
+        // cap data size unless asked for full text
+        r->limit = x->f_full[sel] ? 0 : x->limit;
+        neo_unlock(x);
+    }
+
+    int fds[2];
+    if (pipe(fds) < 0) {
+        recv_stop(x, sel);
+        neo_own(NULL, x, false, sel, NULL, 0, 0);
+        return;
+    }
+    ext_data_control_offer_v1_receive(offer, mime[best_mime], fds[1]);
+    close(fds[1]);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    r->fd = fds[0];
+#if defined(WITH_LUV)
+    uv_watch(x->L, r->fd, "r", cb_pipe);
+#endif // WITH_LUV
+}
+
+
+// start reading pending offer (see neo_fetch)
+static void recv_fetch(neo_X* x, int sel)
+{
+    neo_Recv* r = &x->recv[sel];
+
+    if (r->offer == NULL) {
+        // nothing to read
+        if (neo_lock(x)) {
+            neo_signal(x, sel);
+            neo_unlock(x);
+        }
+    } else if (r->fd < 0) {
+        recv_start(x, sel, r->offer, r->mime);
+    }
+}
+
+
+// read available pipe data
+static void recv_pipe(neo_X* x, int sel)
+{
+    neo_Recv* r = &x->recv[sel];
+    size_t pos = r->pos;
+
+    while (r->fd >= 0) {
+        // grow buffer by half
+        if (r->pos >= r->size) {
+            size_t size = r->size + r->size / 2;
+            if (size < r->pos + RECV_CHUNK)
+                size = r->pos + RECV_CHUNK;
+            uint8_t* data = neo_realloc(r->data, size - 1 - sizeof("utf-8"));
+            if (data == NULL) {
+                // out of memory: keep what we have
+                recv_done(x, sel);
+                break;
+            }
+            r->data = data;
+            r->size = size;
         }
 
-        // output selection
-        if (n > 0)
-            n = write(fd, buf, cb);
+        // read one octet past limit to tell it is truncated
+        size_t room = r->size - r->pos;
+        size_t end = 1 + sizeof("utf-8") + r->limit + 1;
+        if (r->limit > 0 && end - r->pos < room)
+            room = end - r->pos;
+
+        ssize_t part = read(r->fd, r->data + r->pos, room);
+        if (part > 0) {
+            r->pos += part;
+            if (r->limit > 0 && r->pos > 1 + sizeof("utf-8") + r->limit) {
+                // limit reached: drop the rest
+                r->pos = 1 + sizeof("utf-8") + r->limit;
+                r->trunc = true;
+                recv_done(x, sel);
+            }
+        } else if (part < 0 && errno == EINTR)
+            continue;
+        else if (part < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        else
+            recv_done(x, sel);
+    }
+
+    // extend fetch deadline
+    if (r->pos > pos && neo_lock(x)) {
+        x->till[sel] = now_ms() + RECV_TIMEOUT;
         neo_unlock(x);
     }
+}
+
 
-    close(fd);
+// complete offer reading and publish selection
+static void recv_done(neo_X* x, int sel)
+{
+    neo_Recv* r = &x->recv[sel];
+    uint8_t* data = r->data;
+    size_t cb = (r->pos > 1 + sizeof("utf-8")) ? r->pos - 1 - sizeof("utf-8") : 0;
+
+    if (r->pos <= r->base) {
+        // nothing to do
+        cb = 0;
+    } else if (r->mime == 0) {
+        // _VIMENC_TEXT
+        if (r->pos < 1 + sizeof("utf-8")
+            || memcmp(data + 1, "utf-8", sizeof("utf-8")) != 0) {
+            // Vim must have UTF8_STRING
+            recv_start(x, sel, r->offer, 4);
+            return;
+        }
+    } else if (r->mime == 1) {
+        // _VIM_TEXT
+        data[0] = data[sizeof("utf-8")];
+        data[sizeof("utf-8")] = 0;
+    } else {
+        // no conversion
+        data[0] = MAUTO;
+    }
+
+    // transfer data ownership; keep offer to read it again (see expire)
+    r->data = NULL;
+    recv_close(x, sel);
+
+    // keep whole lines only
+    if (r->trunc && cb > 0)
+        cb = neo_cut(data + 1 + sizeof("utf-8"), cb);
+    if (neo_lock(x)) {
+        x->f_trunc[sel] = r->trunc;
+        x->f_full[sel] = false;
+        neo_unlock(x);
+    }
+
+    if (cb == 0) {
+        neo_free(data);
+        data = NULL;
+    } else if (r->size > 1 + sizeof("utf-8") + cb) {
+        // shrink to fit
+        uint8_t* data2 = neo_realloc(data, cb);
+        if (data2 != NULL)
+            data = data2;
+    }
+    neo_take(NULL, x, false, sel, data, cb);
 }
 
 
-// read specific mime type from offer
-static void* offer_read(neo_X* x, struct ext_data_control_offer_v1* offer,
-    const char* mime, size_t* pcb)
+// close pipe and free buffer
+static void recv_close(neo_X* x, int sel)
 {
-    uint8_t* ptr = NULL;
-    size_t total = 0;
-    int fds[2];
+    neo_Recv* r = &x->recv[sel];
 
-    if (pipe(fds) == 0) {
-        ext_data_control_offer_v1_receive(offer, mime, fds[1]);
-        wl_display_roundtrip(x->d);
-        close(fds[1]);
-
-        void* buf = malloc(64 * 1024);
-        if (buf != NULL) {
-            ssize_t part;
-            while ((part = read(fds[0], buf, 64 * 1024)) > 0) {
-                void* ptr2 = realloc(ptr, total + part);
-                if (ptr2 == NULL)
-                    break;
-                ptr = ptr2;
-                memcpy(ptr + total, buf, part);
-                total += part;
+    if (r->fd >= 0) {
+#if defined(WITH_LUV)
+        uv_unwatch(x->L, r->fd);
+#endif // WITH_LUV
+        close(r->fd);
+        r->fd = -1;
+    }
+    neo_free(r->data);
+    r->data = NULL;
+}
+
+
+// abandon offer
+static void recv_stop(neo_X* x, int sel)
+{
+    neo_Recv* r = &x->recv[sel];
+
+    recv_close(x, sel);
+    if (r->offer != NULL) {
+        ext_data_control_offer_v1_destroy(r->offer);
+        r->offer = NULL;
+    }
+}
+
+
+// write as much as pipe accepts
+static void send_next(neo_X* x, neo_Send* s)
+{
+    while (s->fd >= 0) {
+        struct iovec* iov = (s->iov[0].iov_len > 0) ? &s->iov[0] : &s->iov[1];
+        int count = (int)(&s->iov[2] - iov);
+        if (iov->iov_len == 0) {
+            // all done
+            send_end(x, s);
+            break;
+        }
+
+        ssize_t part = -1;
+#if defined(SPLICE_F_NONBLOCK)
+        if (s->f_splice && count == 1) {
+            // no copy from memfd to pipe
+            size_t base;
+            int fd = neo_memfd(s->data, &base);
+            loff_t off = base + ((uint8_t*)iov->iov_base - s->data);
+            part = splice(fd, &off, s->fd, NULL, iov->iov_len, SPLICE_F_NONBLOCK);
+            if (part < 0 && errno == EINVAL)
+                s->f_splice = false;    // not a pipe
+        }
+#endif // SPLICE_F_NONBLOCK
+        if (!s->f_splice || count > 1)
+            part = writev(s->fd, iov, count);
+        if (part < 0 && errno == EINTR)
+            continue;
+        if (part < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (part < 0) {
+            // reader is gone
+            send_end(x, s);
+            break;
+        }
+
+        // skip written octets
+        s->till = now_ms() + SEND_TIMEOUT;
+        for (int i = 0; i < count && part > 0; ++i) {
+            size_t n = ((size_t)part < iov[i].iov_len) ? (size_t)part : iov[i].iov_len;
+            iov[i].iov_base = (uint8_t*)iov[i].iov_base + n;
+            iov[i].iov_len -= n;
+            part -= n;
+        }
+    }
+}
+
+
+// finish transfer to other client
+static void send_end(neo_X* x, neo_Send* s)
+{
+#if defined(WITH_LUV)
+    uv_unwatch(x->L, s->fd);
+#else
+    (void)x;    // unused
+#endif // WITH_LUV
+    close(s->fd);
+    s->fd = -1;
+    neo_free(s->data);
+    s->data = NULL;
+}
+
+
+// drop stalled transfers and trim idle foreign data
+// return poll timeout (ms) or -1
+static int expire(neo_X* x)
+{
+    uint64_t now = now_ms(), next = UINT64_MAX;
+
+    for (size_t i = 0; i < SEND_MAX; ++i) {
+        neo_Send* s = &x->send[i];
+        if (s->fd >= 0) {
+            if (now >= s->till)
+                send_end(x, s);
+            else if (s->till < next)
+                next = s->till;
+        }
+    }
+
+    // trim idle foreign selections
+    if (x->trim > 0 && neo_lock(x)) {
+        for (size_t i = 0; i < sel_total; ++i) {
+            if (!x->f_foreign[i]) {
+                // nothing to trim
+            } else if (x->used[i] + x->trim <= now) {
+                // read offer again on demand
+                set_data(x, i, NULL, 0);
+                x->f_rdy[i] = false;
+            } else if (x->used[i] + x->trim < next) {
+                next = x->used[i] + x->trim;
             }
-            free(buf);
         }
-        close(fds[0]);
+        neo_unlock(x);
+    }
+
+    return (next == UINT64_MAX) ? -1 : (int)(next - now);
+}
+
+
+#if defined(WITH_LUV)
+// uv_share[fd] = uv.new_poll(fd); uv.poll_start(uv_share[fd], events, cb)
+static void uv_watch(lua_State* L, int fd, const char* events, lua_CFunction cb)
+{
+    lua_getfield(L, uv_share, "uv");    // uv or loop => stack
+    lua_getfield(L, -1, "new_poll");
+    lua_pushinteger(L, fd);
+    lua_call(L, 1, 1);                  // poll => stack
+    lua_getfield(L, -2, "poll_start");
+    lua_pushvalue(L, -2);
+    lua_pushstring(L, events);
+    neo_pushcfunction(L, cb);
+    lua_call(L, 3, 0);
+    lua_rawseti(L, uv_share, fd);       // poll <= stack
+    lua_pop(L, 1);                      // uv or loop <= stack
+}
+#endif // WITH_LUV
+
+
+#if defined(WITH_LUV)
+// uv.poll_stop(uv_share[fd]); uv.close(uv_share[fd]); uv_share[fd] = nil
+static void uv_unwatch(lua_State* L, int fd)
+{
+    lua_rawgeti(L, uv_share, fd);       // poll => stack
+    if (!lua_isnil(L, -1)) {
+        lua_getfield(L, uv_share, "uv");
+        lua_getfield(L, -1, "poll_stop");
+        lua_pushvalue(L, -3);
+        lua_call(L, 1, 0);
+        lua_getfield(L, -1, "close");
+        lua_pushvalue(L, -3);
+        lua_call(L, 1, 0);
+        lua_pop(L, 1);
+        lua_pushnil(L);
+        lua_rawseti(L, uv_share, fd);
     }
+    lua_pop(L, 1);                      // poll <= stack
+}
+#endif // WITH_LUV
+
+
+#if defined(WITH_LUV)
+// run uv_loop until stop condition or deadline (may be extended meanwhile)
+static void modal_loop(lua_State* L, bool* stop, uint64_t* till)
+{
+    lua_getfield(L, uv_share, "uv");    // uv or loop => stack
+
+    // run nested loop
+    do {
+        // uv.run"once"
+        lua_getfield(L, -1, "run");
+        lua_pushliteral(L, "once");
+        lua_call(L, 1, 0);
+
+        // check stop condition
+        if (*stop)
+            break;
+    } while (now_ms() < *till);
+
+    lua_pop(L, 1);                      // uv or loop <= stack
+}
+#endif // WITH_LUV
+
+
+// get monotonic time in ms
+static uint64_t now_ms(void)
+{
+    struct timespec t;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &t) < 0)
+        return 0;
 
-    *pcb = total;
-    return ptr;
+    return t.tv_sec * 1000 + t.tv_nsec / 1000000;
 }
@@ -1,6 +1,6 @@
 /*
  * neoclip - Neovim clipboard provider
- * Last Change:  2025 Jun 21
+ * Last Change:  2026 Oct 16
  * License:      https://unlicense.org
  * URL:          https://github.com/matveyt/neoclip
  */
@@ -10,6 +10,7 @@
 #define NEO_WAYLAND_H
 
 #include "neoclip_nix.h"
+#include <sys/uio.h>
 #include <wayland-client-core.h>
 #include <wayland-ext-data-control-client-protocol.h>
 #include <wayland-wlr-data-control-client-protocol.h>
@@ -40,6 +41,41 @@ enum {
 
 typedef void (*WAYLAND_LISTENER)(void);
 
+// offer user data: best mime index | OFFER_OWN
+#define OFFER_OWN 0x100
+
+// pipe read size
+#define RECV_CHUNK 0x10000
+// fetch timeout (ms), extended by transfer progress
+#define RECV_TIMEOUT 1000
+
+// selection transfer in progress
+typedef struct {
+    struct ext_data_control_offer_v1* offer;    // offer being read (NULL => none)
+    size_t mime;                                // mime type index
+    int fd;                                     // pipe read end (-1 => none)
+    uint8_t* data;                              // _VIMENC_TEXT (see neo_alloc)
+    size_t size;                                // allocated size (header included)
+    size_t base;                                // offset of pipe data
+    size_t pos;                                 // current write offset
+    size_t limit;                               // max. text size (0 => unlimited)
+    bool trunc;                                 // data was cut at limit
+} neo_Recv;
+
+// max. concurrent transfers to other clients
+#define SEND_MAX 16
+// stalled transfer timeout (ms)
+#define SEND_TIMEOUT 5000
+
+// outgoing transfer in progress
+typedef struct {
+    int fd;                                     // pipe write end (-1 => none)
+    uint8_t* data;                              // referenced data (see neo_ref)
+    struct iovec iov[2];                        // type and text left to write
+    bool f_splice;                              // data is in memfd (see neo_memfd)
+    uint64_t till;                              // deadline
+} neo_Send;
+
 // driver state
 struct neo_X {
     struct wl_display* d;                       // Wayland display
@@ -50,9 +86,30 @@ struct neo_X {
     const struct wl_interface* dcs_iface;       // ext or zwlr
     uint8_t* data[sel_total];                   // Selection: _VIMENC_TEXT
     size_t cb[sel_total];                       // Selection: text size only
+    neo_Recv recv[sel_total];                   // Selection: transfer in progress
+    bool f_rdy[sel_total];                      // Selection: "ready" flag
+    uint64_t till[sel_total];                   // Selection: fetch deadline
+    bool f_foreign[sel_total];                  // Selection: data came from offer
+    uint64_t used[sel_total];                   // Selection: last access
+    uint64_t trim;                              // trim idle foreign data after ms
+    bool f_trunc[sel_total];                    // Selection: data was cut at limit
+    bool f_full[sel_total];                     // Selection: fetch ignoring limit
+    size_t limit;                               // max. text size (0 => unlimited)
+    bool eager;                                 // read offers upon selection event
+    size_t echo;                                // own offers not read back
+    neo_Send send[SEND_MAX];                    // transfers to other clients
+#if defined(WITH_LUV)
+    lua_State* L;                               // Lua state running our callback
+    bool f_write;                               // display poll has "w" event
+    uint64_t timer;                             // timer deadline (0 => stopped)
+    size_t polls;                               // display poll callbacks
+    size_t timers;                              // timer callbacks
+#endif // WITH_LUV
 #if defined(WITH_THREADS)
     pthread_mutex_t lock;                       // Mutex lock
+    pthread_cond_t c_rdy[sel_total];            // Selection: "ready" condition
     pthread_t tid;                              // Thread ID
+    int fd[2];                                  // Command pipe
 #endif // WITH_THREADS
 };
 
@@ -76,23 +133,42 @@ static void data_control_source_send_clip(void* X,
 static void data_control_source_cancelled(void* X,
     struct ext_data_control_source_v1* dcs);
 
-static size_t alloc_data(neo_X* x, int sel, size_t cb);
-static int dispatch_event(struct wl_display* d, bool valid);
-static int prepare_event(struct wl_display* d);
 static void sel_read(neo_X* x, int sel, struct ext_data_control_offer_v1* offer);
+static void set_data(neo_X* x, int sel, uint8_t* data, size_t cb);
 static void sel_write(neo_X* x, int sel, const char* mime_type, int fd);
-static void* offer_read(neo_X* x, struct ext_data_control_offer_v1* offer,
-    const char* mime, size_t* pcb);
+static void recv_start(neo_X* x, int sel, struct ext_data_control_offer_v1* offer,
+    size_t best_mime);
+static void recv_fetch(neo_X* x, int sel);
+static void recv_pipe(neo_X* x, int sel);
+static void recv_done(neo_X* x, int sel);
+static void recv_close(neo_X* x, int sel);
+static void recv_stop(neo_X* x, int sel);
+static void send_next(neo_X* x, neo_Send* s);
+static void send_end(neo_X* x, neo_Send* s);
+static int expire(neo_X* x);
 
 #if defined(WITH_LUV)
-static int cb_prepare(lua_State* L);
 static int cb_poll(lua_State* L);
+static int cb_timer(lua_State* L);
+static void settle(neo_X* x, lua_State* L);
+static int cb_pipe(lua_State* L);
+static int cb_send(lua_State* L);
+static void flush_event(neo_X* x, lua_State* L);
+static void uv_watch(lua_State* L, int fd, const char* events, lua_CFunction cb);
+static void uv_unwatch(lua_State* L, int fd);
+static void modal_loop(lua_State* L, bool* stop, uint64_t* till);
 #endif // WITH_LUV
 
 #if defined(WITH_THREADS)
 static void* thread_main(void* X);
+static int dispatch_event(struct wl_display* d, bool valid);
+static int prepare_event(struct wl_display* d);
+static void on_command(neo_X* x);
+static void post_command(neo_X* x, int sel);
 #endif // WITH_THREADS
 
+static uint64_t now_ms(void);
+
 // inline helpers
 static inline bool neo_lock(neo_X* x)
 {
@@ -112,6 +188,16 @@ static inline bool neo_unlock(neo_X* x)
     return true;
 #endif // WITH_THREADS
 }
+static inline bool neo_signal(neo_X* x, int sel)
+{
+    x->f_rdy[sel] = true;
+    neo_notify(sel);
+#if defined(WITH_THREADS)
+    return (pthread_cond_signal(&x->c_rdy[sel]) == 0);
+#else
+    return true;
+#endif // WITH_THREADS
+}
 static inline void* get_data_device(struct neo_X* x)
 {
     return wl_proxy_marshal_constructor((struct wl_proxy*)x->dcm,
@@ -1,19 +1,35 @@
 /*
  * neoclip - Neovim clipboard provider
- * Last Change:  2025 Jun 21
+ * Last Change:  2026 Oct 16
  * License:      https://unlicense.org
  * URL:          https://github.com/matveyt/neoclip
  */
 
 
 #include "neo_x11.h"
+#include <errno.h>
 #include <limits.h>
+#include <poll.h>
 #include <time.h>
+#if defined(WITH_THREADS)
+#include <fcntl.h>
+#include <unistd.h>
+#endif // WITH_THREADS
+
+
+// previous X error handler (see on_error)
+static XErrorHandler prev_error = NULL;
 
 
 // init state and start thread
 int neo_start(lua_State* L)
 {
+    // uv_share.opts = opts
+    if (lua_istable(L, 1)) {
+        lua_pushvalue(L, 1);
+        lua_setfield(L, uv_share, "opts");
+    }
+
     neo_X* x = neo_x(L);
     if (x == NULL) {
 #if defined(WITH_THREADS)
@@ -36,6 +52,10 @@ int neo_start(lua_State* L)
             return lua_error(L);
         }
 
+        // foreign windows may be gone at any time (see on_error)
+        if (!neo_did(L, "XSetErrorHandler"))
+            prev_error = XSetErrorHandler(on_error);
+
         // atom names
         static /*const*/ char* /*const*/ atom_name[total] = {
             [sel_prim] = "PRIMARY",
@@ -51,6 +71,18 @@ int neo_start(lua_State* L)
             [wm_dele] = "WM_DELETE_WINDOW",
             [neo_ready] = "NEO_READY",
             [neo_offer] = "NEO_OFFER",
+            [neo_prim] = "NEO_PRIMARY",
+            [neo_sec] = "NEO_SECONDARY",
+            [neo_clip] = "NEO_CLIPBOARD",
+            [neo_multi + sel_prim * 3] = "NEO_PRIMARY_TARGETS",
+            [neo_multi + sel_prim * 3 + 1] = "NEO_PRIMARY_VIMENC",
+            [neo_multi + sel_prim * 3 + 2] = "NEO_PRIMARY_UTF8",
+            [neo_multi + sel_sec * 3] = "NEO_SECONDARY_TARGETS",
+            [neo_multi + sel_sec * 3 + 1] = "NEO_SECONDARY_VIMENC",
+            [neo_multi + sel_sec * 3 + 2] = "NEO_SECONDARY_UTF8",
+            [neo_multi + sel_clip * 3] = "NEO_CLIPBOARD_TARGETS",
+            [neo_multi + sel_clip * 3 + 1] = "NEO_CLIPBOARD_VIMENC",
+            [neo_multi + sel_clip * 3 + 2] = "NEO_CLIPBOARD_UTF8",
             [targets] = "TARGETS",
             [dele] = "DELETE",
             [multi] = "MULTIPLE",
@@ -70,19 +102,60 @@ int neo_start(lua_State* L)
         x->w = XCreateSimpleWindow(x->d, XDefaultRootWindow(x->d), 0, 0, 1, 1, 0, 0, 0);
         x->delta = CurrentTime;
         XInternAtoms(x->d, atom_name, total, False, x->atom);
-#if defined(WITH_THREADS)
-        XSetWMProtocols(x->d, x->w, &x->atom[wm_dele], 1);
-#endif // WITH_THREADS
         for (size_t i = 0; i < sel_total; ++i) {
             x->data[i] = NULL;
             x->cb[i] = 0;
             x->stamp[i] = CurrentTime;
             x->f_rdy[i] = false;
+            x->till[i] = CurrentTime;
+            x->recv[i].data = NULL;
+            x->recv[i].busy = x->recv[i].incr = x->recv[i].drain = false;
+            x->recv[i].again = None;
+            x->owner[i] = None;
+            x->since[i] = CurrentTime;
+            x->f_valid[i] = false;
+            x->f_foreign[i] = false;
+            x->f_trunc[i] = false;
+            x->f_full[i] = false;
+            x->used[i] = CurrentTime;
 #if defined(WITH_THREADS)
             pthread_cond_init(&x->c_rdy[i], NULL);
 #endif // WITH_THREADS
         }
 
+        // INCR chunk size: max request size minus overhead
+        size_t maxreq = XExtendedMaxRequestSize(x->d);
+        if (maxreq == 0)
+            maxreq = XMaxRequestSize(x->d);
+        x->chunk = maxreq * 4 - 100;
+        if (x->chunk > SEND_CHUNK)
+            x->chunk = SEND_CHUNK;
+        for (size_t i = 0; i < SEND_MAX; ++i)
+            x->send[i].w = None;
+        for (size_t i = 0; i < TGT_MAX; ++i)
+            x->tgt[i].owner = None;
+        x->tgt_next = 0;
+        x->cached = 0;
+
+        // track selection owners
+        x->xfixes = 0;
+        x->prefetch = neo_opt(L, "prefetch");
+        x->multiple = neo_opt(L, "multiple");
+        x->trim = neo_optint(L, "trim", 0) * 1000;
+        x->limit = neo_optint(L, "limit", 0);
+        neo_memfd_min = neo_optint(L, "memfd", MEMFD_MIN);
+#if defined(WITH_XFIXES)
+        int error_base;
+        if (XFixesQueryExtension(x->d, &x->xfixes, &error_base)) {
+            for (size_t i = 0; i < sel_total; ++i)
+                XFixesSelectSelectionInput(x->d, x->w, x->atom[i],
+                    XFixesSetSelectionOwnerNotifyMask
+                    | XFixesSelectionWindowDestroyNotifyMask
+                    | XFixesSelectionClientCloseNotifyMask);
+        } else
+            x->xfixes = 0;
+#endif // WITH_XFIXES
+
         // metatable for state
         luaL_newmetatable(L, lua_tostring(L, uv_module));
         neo_pushcfunction(L, neo__gc);
@@ -91,6 +164,7 @@ int neo_start(lua_State* L)
 
         // uv_share.x = x
         lua_setfield(L, uv_share, "x");
+        neo_ffi_x = x;
 
 #if defined(WITH_LUV)
         // start polling the display
@@ -102,21 +176,19 @@ int neo_start(lua_State* L)
         }
         lua_replace(L, -2);
 
-        // local prepare = uv.new_prepare()
-        lua_getfield(L, -1, "new_prepare");
-        lua_call(L, 0, 1);                      // prepare => stack
-        // uv.prepare_start(prepare, cb_prepare)
-        lua_getfield(L, -2, "prepare_start");
-        lua_pushvalue(L, -2);
-        neo_pushcfunction(L, cb_prepare);
-        lua_call(L, 2, 0);
+        // uv_share.timer = uv.new_timer()
+        lua_getfield(L, -1, "new_timer");
+        lua_call(L, 0, 1);
+        lua_setfield(L, uv_share, "timer");
+        x->timer = 0;
+        x->polls = x->timers = 0;
 
         // local poll = uv.new_poll(XConnectionNumber(x->d))
-        lua_getfield(L, -2, "new_poll");
+        lua_getfield(L, -1, "new_poll");
         lua_pushinteger(L, XConnectionNumber(x->d));
         lua_call(L, 1, 1);                      // poll => stack
         // uv.poll_start(poll, "r", cb_poll)
-        lua_getfield(L, -3, "poll_start");
+        lua_getfield(L, -2, "poll_start");
         lua_pushvalue(L, -2);
         lua_pushliteral(L, "r");
         neo_pushcfunction(L, cb_poll);
@@ -124,20 +196,37 @@ int neo_start(lua_State* L)
 
         // uv_share.poll = poll
         lua_setfield(L, uv_share, "poll");      // poll <= stack
-        // uv_share.prepare = prepare
-        lua_setfield(L, uv_share, "prepare");   // prepare <= stack
         // uv_share.uv = vim.uv or vim.loop
         lua_setfield(L, uv_share, "uv");        // uv or loop <= stack
 
         // get timestamp ASAP
         ask_timestamp(x);
+        settle(x, L);
 #endif // WITH_LUV
 
 #if defined(WITH_THREADS)
+        // command pipe: non-blocking read end
+        if (pipe(x->fd) < 0) {
+            XDestroyWindow(x->d, x->w);
+            XCloseDisplay(x->d);
+            lua_pushliteral(L, "pipe failed");
+            return lua_error(L);
+        }
+        fcntl(x->fd[0], F_SETFL, O_NONBLOCK);
+        fcntl(x->fd[0], F_SETFD, FD_CLOEXEC);
+        fcntl(x->fd[1], F_SETFD, FD_CLOEXEC);
+
         // start thread
         pthread_mutex_init(&x->lock, NULL);
         pthread_create(&x->tid, NULL, thread_main, x);
 #endif // WITH_THREADS
+    } else if (lua_istable(L, 1) && neo_lock(x)) {
+        // update options
+        x->prefetch = neo_opt(L, "prefetch");
+        x->multiple = neo_opt(L, "multiple");
+        x->trim = neo_optint(L, "trim", 0) * 1000;
+        x->limit = neo_optint(L, "limit", 0);
+        neo_unlock(x);
     }
 
     lua_pushnil(L);
@@ -149,6 +238,8 @@ int neo_start(lua_State* L)
 int neo__gc(lua_State* L)
 {
     neo_X* x = (neo_X*)neo_checkud(L, 1);
+    if (neo_ffi_x == x)
+        neo_ffi_x = NULL;
 
 #if defined(WITH_LUV)
     lua_getfield(L, uv_share, "uv");    // uv or loop => stack
@@ -168,32 +259,38 @@ int neo__gc(lua_State* L)
         lua_setfield(L, uv_share, "poll");
     }
 
-    // uv.prepare_stop(prepare)
-    lua_getfield(L, -1, "prepare_stop");
-    lua_getfield(L, uv_share, "prepare");
+    // uv.timer_stop(uv_share.timer)
+    lua_getfield(L, -1, "timer_stop");
+    lua_getfield(L, uv_share, "timer");
     if (lua_isnil(L, -1)) {
         lua_pop(L, 2);
     } else {
         lua_call(L, 1, 0);
-        // uv.close(prepare)
+        // uv.close(timer)
         lua_getfield(L, -1, "close");
-        lua_getfield(L, uv_share, "prepare");
+        lua_getfield(L, uv_share, "timer");
         lua_call(L, 1, 0);
-        // uv_share.prepare = nil
+        // uv_share.timer = nil
         lua_pushnil(L);
-        lua_setfield(L, uv_share, "prepare");
+        lua_setfield(L, uv_share, "timer");
     }
 #endif // WITH_LUV
 
 #if defined(WITH_THREADS)
-    client_message(x, wm_proto, wm_dele);
+    post_command(x, wm_dele, sel_clip);
     pthread_join(x->tid, NULL);
     pthread_mutex_destroy(&x->lock);
+    close(x->fd[0]);
+    close(x->fd[1]);
 #endif // WITH_THREADS
 
     // clear data
+    for (size_t i = 0; i < SEND_MAX; ++i)
+        if (x->send[i].w != None)
+            send_end(x, &x->send[i]);
     for (size_t i = 0; i < sel_total; ++i) {
-        free(x->data[i]);
+        neo_free(x->data[i]);
+        neo_free(x->recv[i].data);
 #if defined(WITH_THREADS)
         pthread_cond_destroy(&x->c_rdy[i]);
 #endif // WITH_THREADS
@@ -206,93 +303,220 @@ int neo__gc(lua_State* L)
 
 
 // fetch new selection
-void neo_fetch(lua_State* L, int ix, int sel)
+// (fetch_full) => fetch again if it was truncated
+// (fetch_sent) => just wait for neo_request
+// (return true) => text is truncated (see recv_cut)
+bool neo_fetch(lua_State* L, int ix, int sel, int flags, neo_Reader fn)
 {
+    bool trunc = false;
+
     neo_X* x = neo_x(L);
     if (x != NULL && neo_lock(x)) {
-#if defined(WITH_THREADS)
-        // send request
-        x->f_rdy[sel] = false;
-        client_message(x, neo_ready, sel);
-
-        // wait upto 1 second
-        struct timespec t;
-        if (clock_gettime(CLOCK_REALTIME, &t) == 0) {
-            ++t.tv_sec;
-            while (!x->f_rdy[sel]
-                && pthread_cond_timedwait(&x->c_rdy[sel], &x->lock, &t) == 0)
-                /*nothing*/;
+        if ((flags & fetch_full) && x->f_trunc[sel]) {
+            // ignore limit once
+            x->f_full[sel] = true;
+            x->f_valid[sel] = false;
         }
+
+        if (x->f_valid[sel]) {
+            // owner is unchanged: no roundtrip
+            x->f_rdy[sel] = true;
+        } else {
+#if defined(WITH_THREADS)
+            // send request
+            if (!(flags & fetch_sent)) {
+                x->f_rdy[sel] = false;
+                x->till[sel] = now_ms() + RECV_TIMEOUT;
+                post_command(x, neo_ready, sel);
+            }
+
+            // wait until deadline (INCR progress extends it)
+            for (Time now; !x->f_rdy[sel] && (now = now_ms()) < x->till[sel]; ) {
+                struct timespec t;
+                if (clock_gettime(CLOCK_REALTIME, &t) < 0)
+                    break;
+                Time ms = x->till[sel] - now;
+                t.tv_sec += ms / 1000;
+                t.tv_nsec += (ms % 1000) * 1000000;
+                if (t.tv_nsec >= 1000000000) {
+                    ++t.tv_sec;
+                    t.tv_nsec -= 1000000000;
+                }
+                pthread_cond_timedwait(&x->c_rdy[sel], &x->lock, &t);
+            }
 #endif // WITH_THREADS
 
 #if defined(WITH_LUV)
-        // attempt to convert selection
-        Window owner = XGetSelectionOwner(x->d, x->atom[sel]);
-        if (owner == x->w) {
-            // no conversion needed
-            neo_signal(x, sel);
-        } else if (owner == None) {
-            // empty selection
-            neo_own(x, false, sel, NULL, 0, 0);
-        } else {
-            // what TARGETS are supported?
-            x->f_rdy[sel] = false;
-            XConvertSelection(x->d, x->atom[sel], x->atom[targets], x->atom[neo_ready],
-                x->w, time_diff(x->delta));
-            modal_loop(L, &x->f_rdy[sel], 1000);
-        }
+            if (!(flags & fetch_sent)) {
+                // attempt to convert selection
+                Window owner = XGetSelectionOwner(x->d, x->atom[sel]);
+                if (owner == x->w) {
+                    // no conversion needed
+                    neo_signal(x, sel);
+                } else if (owner == None) {
+                    // empty selection
+                    neo_own(L, x, false, sel, NULL, 0, 0);
+                } else {
+                    // what TARGETS are supported?
+                    x->f_rdy[sel] = false;
+                    x->till[sel] = now_ms() + RECV_TIMEOUT;
+                    recv_start(x, sel, owner, time_diff(x->delta));
+                }
+            }
+
+            // wait until deadline (INCR progress extends it)
+            if (!x->f_rdy[sel])
+                modal_loop(x, &x->f_rdy[sel], &x->till[sel]);
+            settle(x, L);
 #endif // WITH_LUV
+        }
+
+        // take snapshot and release lock
+        x->used[sel] = now_ms();
+        size_t cb = x->cb[sel];
+        uint8_t* data = x->f_rdy[sel] ? neo_ref(x->data[sel]) : NULL;
+        trunc = (data != NULL && cb > 0 && x->f_trunc[sel]);
+        neo_unlock(x);
 
         // split selection into t[ix]
-        if (x->f_rdy[sel] && x->cb[sel] > 0)
-            neo_split(L, ix, x->data[sel] + 1 + sizeof("utf-8"), x->cb[sel],
-                x->data[sel][0]);
+        if (fn != NULL && data != NULL && cb > 0)
+            fn(L, ix, data + 1 + sizeof("utf-8"), cb, data[0]);
+        neo_free(data);
+    }
+
+    return trunc;
+}
+
+
+// start fetching selection without waiting (see neo_get_async)
+// (return true) => data is ready
+bool neo_request(lua_State* L, int sel)
+{
+    neo_X* x = neo_x(L);
+    bool ready = true;
+
+    if (x != NULL && neo_lock(x)) {
+        if (!x->f_valid[sel]) {
+#if defined(WITH_THREADS)
+            x->f_rdy[sel] = false;
+            x->till[sel] = now_ms() + RECV_TIMEOUT;
+            post_command(x, neo_ready, sel);
+            ready = false;
+#endif // WITH_THREADS
+
+#if defined(WITH_LUV)
+            Window owner = XGetSelectionOwner(x->d, x->atom[sel]);
+            if (owner == x->w) {
+                // no conversion needed
+                neo_signal(x, sel);
+            } else if (owner == None) {
+                // empty selection
+                neo_own(L, x, false, sel, NULL, 0, 0);
+            } else {
+                // what TARGETS are supported?
+                x->f_rdy[sel] = false;
+                x->till[sel] = now_ms() + RECV_TIMEOUT;
+                recv_start(x, sel, owner, time_diff(x->delta));
+                ready = false;
+            }
+            settle(x, L);
+#endif // WITH_LUV
+        }
 
-        // release lock
         neo_unlock(x);
     }
+
+    return ready;
 }
 
 
-// own new selection
-// (cb == 0) => empty selection
-void neo_own(neo_X* x, bool offer, int sel, const void* ptr, size_t cb, int type)
+// take new selection data (see neo_alloc)
+// (data == NULL) => empty selection
+// (L == NULL) => no Lua frame, e.g. LuaJIT FFI
+void neo_take(lua_State* L, neo_X* x, bool offer, int sel, uint8_t* data, size_t cb)
 {
+    (void)L;    // unused
     if (neo_lock(x)) {
-        // _VIMENC_TEXT: type 'encoding' NUL text
-        cb = alloc_data(x, sel, cb);
-        if (cb > 0) {
-            x->data[sel][0] = type;
-            memcpy(x->data[sel] + 1, "utf-8", sizeof("utf-8"));
-            memcpy(x->data[sel] + 1 + sizeof("utf-8"), ptr, cb);
-        }
+        set_data(x, sel, data, cb);
+        x->f_foreign[sel] = (!offer && data != NULL);
+        if (offer)
+            x->f_trunc[sel] = x->f_full[sel] = false;
         x->stamp[sel] = time_diff(x->delta);
 
-        if (offer)
+        if (offer) {
 #if defined(WITH_THREADS)
-            client_message(x, neo_offer, sel);
+            post_command(x, neo_offer, sel);
 #else
             XSetSelectionOwner(x->d, x->atom[sel], x->w, x->stamp[sel]);
+            XFlush(x->d);
 #endif // WITH_THREADS
-        else
+        } else
             neo_signal(x, sel);
 
         neo_unlock(x);
+    } else
+        neo_free(data);
+}
+
+
+// get referenced selection data (see neo_ref)
+uint8_t* neo_peek(neo_X* x, int sel, size_t* pcb)
+{
+    uint8_t* data = NULL;
+
+    *pcb = 0;
+    if (neo_lock(x)) {
+        data = neo_ref(x->data[sel]);
+        *pcb = x->cb[sel];
+        x->used[sel] = now_ms();
+        neo_unlock(x);
     }
+
+    return data;
+}
+
+
+// is selection data cut at limit? (see recv_cut)
+bool neo_truncated(neo_X* x, int sel)
+{
+    bool trunc = false;
+
+    if (neo_lock(x)) {
+        trunc = (x->cb[sel] > 0 && x->f_trunc[sel]);
+        neo_unlock(x);
+    }
+
+    return trunc;
+}
+
+
+// set counters into table on stack top
+void neo_count(neo_X* x, lua_State* L)
+{
+    lua_pushinteger(L, x->cached);
+    lua_setfield(L, -2, "cached");
+#if defined(WITH_LUV)
+    lua_pushinteger(L, x->polls);
+    lua_setfield(L, -2, "polls");
+    lua_pushinteger(L, x->timers);
+    lua_setfield(L, -2, "timers");
+#endif // WITH_LUV
 }
 
 
 #if defined(WITH_LUV)
-// uv_prepare_t callback
-static int cb_prepare(lua_State* L)
+// uv_poll_t callback: drain all events
+static int cb_poll(lua_State* L)
 {
     neo_X* x = neo_x(L);
-    if (x != NULL) {
+    if (x != NULL && lua_isnil(L, 1)) {
+        ++x->polls;
         XEvent xe;
         while (XPending(x->d) > 0) {
             XNextEvent(x->d, &xe);
             dispatch_event(x, &xe);
         }
+        settle(x, L);
     }
 
     return 0;
@@ -301,17 +525,56 @@ static int cb_prepare(lua_State* L)
 
 
 #if defined(WITH_LUV)
-// uv_poll_t callback
-static int cb_poll(lua_State* L)
+// uv_timer_t callback
+static int cb_timer(lua_State* L)
 {
     neo_X* x = neo_x(L);
-    if (x != NULL && lua_isnil(L, 1) && strchr(lua_tostring(L, 2), 'r') != NULL) {
-        XEvent xe;
+    if (x != NULL) {
+        ++x->timers;
+        x->timer = 0;
+        settle(x, L);
+    }
+
+    return 0;
+}
+#endif // WITH_LUV
+
+
+#if defined(WITH_LUV)
+// dispatch events already queued by Xlib and flush requests
+// Note: no syscalls unless there is output
+static void settle(neo_X* x, lua_State* L)
+{
+    XEvent xe;
+    while (XEventsQueued(x->d, QueuedAlready) > 0) {
         XNextEvent(x->d, &xe);
         dispatch_event(x, &xe);
     }
+    XFlush(x->d);
 
-    return 0;
+    // (re)arm timer for the nearest deadline
+    int timeout = expire(x);
+    Time till = (timeout < 0) ? 0 : now_ms() + timeout;
+    if (till != x->timer) {
+        x->timer = till;
+
+        lua_getfield(L, uv_share, "uv");    // uv or loop => stack
+        if (timeout < 0) {
+            // uv.timer_stop(uv_share.timer)
+            lua_getfield(L, -1, "timer_stop");
+            lua_getfield(L, uv_share, "timer");
+            lua_call(L, 1, 0);
+        } else {
+            // uv.timer_start(uv_share.timer, timeout, 0, cb_timer)
+            lua_getfield(L, -1, "timer_start");
+            lua_getfield(L, uv_share, "timer");
+            lua_pushinteger(L, timeout);
+            lua_pushinteger(L, 0);
+            neo_pushcfunction(L, cb_timer);
+            lua_call(L, 4, 0);
+        }
+        lua_pop(L, 1);                      // uv or loop <= stack
+    }
 }
 #endif // WITH_LUV
 
@@ -324,33 +587,65 @@ static void* thread_main(void* X)
     XEvent xe;
 
     ask_timestamp(x);
-    do {
-        XNextEvent(x->d, &xe);
-    } while (dispatch_event(x, &xe));
+    for (;;) {
+        // process X events
+        while (XPending(x->d) > 0) {
+            XNextEvent(x->d, &xe);
+            if (!dispatch_event(x, &xe))
+                return NULL;
+        }
 
-    return NULL;
+        // wait for X event or command upto deadline
+        struct pollfd pfd[] = {
+            { .fd = XConnectionNumber(x->d), .events = POLLIN },
+            { .fd = x->fd[0], .events = POLLIN },
+        };
+        if (poll(pfd, 2, expire(x)) > 0 && (pfd[1].revents & POLLIN) && !on_command(x))
+            return NULL;
+    }
 }
 #endif // WITH_THREADS
 
 
+// X error handler
+// ignore BadWindow: owner or requestor window has gone before XSelectInput
+static int on_error(Display* d, XErrorEvent* xee)
+{
+    if (xee->error_code == BadWindow)
+        return 0;
+    return (prev_error != NULL) ? prev_error(d, xee) : 0;
+}
+
+
 // X event dispatcher
 static bool dispatch_event(neo_X* x, XEvent* xe)
 {
     switch (xe->type) {
-    case ClientMessage:
-#if defined(WITH_THREADS)
-        return on_client_message(x, &xe->xclient);
-#endif // WITH_THREADS
-    break;
     case PropertyNotify:
         if (xe->xproperty.atom == x->atom[timestamp]) {
             x->delta = time_diff(xe->xproperty.time);
-            XSelectInput(x->d, x->w, NoEventMask);
+        } else if (xe->xproperty.window == x->w) {
+            // INCR: owner has sent next chunk
+            if (xe->xproperty.state == PropertyNewValue)
+                recv_next(x, xe->xproperty.atom);
+        } else if (xe->xproperty.state == PropertyDelete) {
+            // INCR: requestor wants next chunk
+            send_next(x, xe->xproperty.window, xe->xproperty.atom);
         }
     break;
+    case DestroyNotify:
+        // INCR: requestor has gone
+        for (size_t i = 0; i < SEND_MAX; ++i)
+            if (x->send[i].w == xe->xdestroywindow.window)
+                send_end(x, &x->send[i]);
+        // selection owner has gone
+        tgt_drop(x, xe->xdestroywindow.window);
+    break;
     case SelectionClear:
         if (xe->xselectionclear.window == x->w && neo_lock(x)) {
-            alloc_data(x, atom2sel(x, xe->xselectionclear.selection), 0);
+            int sel = atom2sel(x, xe->xselectionclear.selection);
+            set_data(x, sel, NULL, 0);
+            x->f_valid[sel] = false;
             neo_unlock(x);
         }
     break;
@@ -365,6 +660,12 @@ static bool dispatch_event(neo_X* x, XEvent* xe)
     case SelectionRequest:
         on_sel_request(x, &xe->xselectionrequest);
     break;
+#if defined(WITH_XFIXES)
+    default:
+        if (x->xfixes != 0 && xe->type == x->xfixes + XFixesSelectionNotify)
+            on_owner_change(x, (XFixesSelectionNotifyEvent*)xe);
+    break;
+#endif // WITH_XFIXES
     }
 
     return true;
@@ -375,98 +676,57 @@ static bool dispatch_event(neo_X* x, XEvent* xe)
 static void on_sel_notify(neo_X* x, XSelectionEvent* xse)
 {
     int sel = atom2sel(x, xse->selection);
-
-    if (xse->property == x->atom[neo_ready]) {
-        // read our property
+    Atom property = x->atom[neo_prim + sel];
+
+    if (xse->target == x->atom[multi] && xse->property != None) {
+        // speculative conversion (see recv_start)
+        recv_multiple(x, sel, xse);
+    } else if (xse->target == x->atom[multi]) {
+        // MULTIPLE is not supported: what TARGETS are?
+        XConvertSelection(x->d, x->atom[sel], x->atom[targets], property, x->w,
+            xse->time);
+        x->recv[sel].till = now_ms() + RECV_TIMEOUT;
+    } else if (xse->property == property) {
+        // get type and size of our property
         Atom type = None;
-        uint8_t* ptr = NULL;
+        unsigned long size = 0;
         unsigned char* xptr = NULL;
-        unsigned long cxptr = 0;
-        XGetWindowProperty(x->d, x->w, x->atom[neo_ready], 0, LONG_MAX, True,
-            AnyPropertyType, &type, &(int){0}, &cxptr, &(unsigned long){0}, &xptr);
-
-        do {
-            uint8_t* buf = (uint8_t*)xptr;
-            size_t cb = cxptr;
-
-            if (type == x->atom[incr]) {
-                // INCR
-                for (cb = 0; ; cb += cxptr) {
-                    XFree(xptr);
-                    XIfEvent(x->d, &(XEvent){0}, is_incr_notify, (XPointer)xse);
-                    XGetWindowProperty(x->d, x->w, x->atom[neo_ready], 0, LONG_MAX,
-                        True, AnyPropertyType, &(Atom){None}, &(int){0}, &cxptr,
-                        &(unsigned long){0}, &xptr);
-                    void* ptr2 = cxptr ? realloc(ptr, cb + cxptr) : NULL;
-                    if (ptr2 == NULL)
-                        break;
-                    ptr = ptr2;
-                    memcpy(ptr + cb, xptr, cxptr);
-                }
-                type = xse->target;
-                buf = ptr;
-            }
-
-            if (cb == 0) {
-                // nothing to do
-            } else if (type == x->atom[atom] || type == x->atom[targets]) {
-                // TARGETS
-                Atom target = best_target(x, (Atom*)buf, cb);
-                if (target != None) {
-                    XConvertSelection(x->d, xse->selection, target, x->atom[neo_ready],
-                        x->w, xse->time);
-                    break;
-                }
-            } else if (type == x->atom[vimenc]) {
-                // _VIMENC_TEXT
-                if (cb >= 1 + sizeof("utf-8")
-                    && memcmp(buf + 1, "utf-8", sizeof("utf-8")) == 0) {
-                    // this is UTF-8
-                    neo_own(x, false, sel, buf + 1 + sizeof("utf-8"),
-                        cb - 1 - sizeof("utf-8"), buf[0]);
-                } else {
-                    // no UTF-8; ask then for UTF8_STRING
-                    XConvertSelection(x->d, xse->selection, x->atom[utf8_string],
-                        x->atom[neo_ready], x->w, xse->time);
-                }
-                break;
-            } else if (type == x->atom[vimtext]) {
-                // _VIM_TEXT: assume UTF-8
-                neo_own(x, false, sel, buf + 1, cb - 1, buf[0]);
-                break;
-            } else if (type == x->atom[plain_utf8] || type == x->atom[utf8_string]
-                || type == x->atom[plain]) {
-                // no conversion
-                neo_own(x, false, sel, buf, cb, MAUTO);
-                break;
-            } else if (type == x->atom[compound] || type == x->atom[string]
-                || type == x->atom[text]) {
-                // COMPOUND_TEXT, STRING or TEXT: attempt to convert to UTF-8
-                XTextProperty xtp = {
-                    .value = buf,
-                    .encoding = type,
-                    .format = 8,
-                    .nitems = cb,
-                };
-                char** list;
-                if (Xutf8TextPropertyToTextList(x->d, &xtp, &list, &(int){0})
-                    == Success) {
-                    neo_own(x, false, sel, list[0], strlen(list[0]), MAUTO);
-                    XFreeStringList(list);
-                    break;
-                }
-            }
-
-            // conversion failed
-            neo_own(x, false, sel, NULL, 0, 0);
-        } while (0);
-
-        free(ptr);
+        XGetWindowProperty(x->d, x->w, property, 0, 0, False,
+            AnyPropertyType, &type, &(int){0}, &(unsigned long){0}, &size, &xptr);
         if (xptr != NULL)
             XFree(xptr);
+
+        neo_Recv* r = &x->recv[sel];
+        if (type == x->atom[incr]) {
+            // INCR: size is a lower bound
+            long* hint = NULL;
+            unsigned long count = 0;
+            XGetWindowProperty(x->d, x->w, property, 0, 1, True,
+                x->atom[incr], &(Atom){None}, &(int){0}, &count, &(unsigned long){0},
+                (unsigned char**)&hint);
+            recv_init(x, r, xse->target, (count > 0 && *hint > 0) ? *hint : 0,
+                xse->time);
+            if (hint != NULL)
+                XFree(hint);
+
+            // chunks come by PropertyNotify (see recv_next)
+            r->incr = true;
+            r->till = now_ms() + RECV_TIMEOUT;
+        } else {
+            recv_init(x, r, type, size, xse->time);
+            recv_property(x, r, property);
+            recv_done(x, sel, r);
+        }
+    } else if (xse->property == None && x->recv[sel].cached) {
+        // cached target is refused: what TARGETS are supported now?
+        tgt_drop(x, x->recv[sel].from);
+        x->recv[sel].cached = false;
+        XConvertSelection(x->d, x->atom[sel], x->atom[targets], property, x->w,
+            xse->time);
+        x->recv[sel].till = now_ms() + RECV_TIMEOUT;
     } else if (xse->property == None) {
         // peer error
-        neo_own(x, false, sel, NULL, 0, 0);
+        recv_fail(x, sel);
     }
 }
 
@@ -485,13 +745,20 @@ static void on_sel_request(neo_X* x, XSelectionRequestEvent* xsre)
         .time = time_diff(x->delta),
     };
 
+    // take snapshot: no lock while serving
+    int sel = atom2sel(x, xsre->selection);
+    uint8_t* data = NULL;
+    size_t cb = 0;
+    Time stamp = CurrentTime;
     if (neo_lock(x)) {
-        int sel = atom2sel(x, xsre->selection);
+        data = neo_ref(x->data[sel]);
+        cb = x->cb[sel];
+        stamp = x->stamp[sel];
+        neo_unlock(x);
 
         // TARGETS: DELETE, MULTIPLE, SAVE_TARGETS, TIMESTAMP, _VIMENC_TEXT, _VIM_TEXT,
         // UTF8_STRING, COMPOUND_TEXT, STRING, TEXT
-        if (xsre->owner != x->w || (xsre->time != CurrentTime &&
-            xsre->time < x->stamp[sel])) {
+        if (xsre->owner != x->w || (xsre->time != CurrentTime && xsre->time < stamp)) {
             // refuse non-matching request
             xse.property = None;
         } else if (xsre->target == x->atom[targets]) {
@@ -500,7 +767,10 @@ static void on_sel_request(neo_X* x, XSelectionRequestEvent* xsre)
                 PropModeReplace, (unsigned char*)&x->atom[targets], total - targets);
         } else if (xsre->target == x->atom[dele]) {
             // response is NULL
-            alloc_data(x, sel, 0);
+            if (neo_lock(x)) {
+                set_data(x, sel, NULL, 0);
+                neo_unlock(x);
+            }
             XChangeProperty(x->d, xse.requestor, xse.property, x->atom[null], 32,
                 PropModeReplace, NULL, 0);
         } else if (xsre->target == x->atom[save]) {
@@ -509,19 +779,19 @@ static void on_sel_request(neo_X* x, XSelectionRequestEvent* xsre)
                 PropModeReplace, NULL, 0);
         } else if (xsre->target == x->atom[multi]) {
             // response is ATOM_PAIR
-            to_multiple(x, sel, &xse);
+            to_multiple(x, data, cb, &xse);
         } else if (xsre->target == x->atom[timestamp]) {
             // response is INTEGER
             XChangeProperty(x->d, xse.requestor, xse.property, x->atom[integer], 32,
-                PropModeReplace, (unsigned char*)&x->stamp[sel], 1);
+                PropModeReplace, (unsigned char*)&stamp, 1);
         } else if (best_target(x, &xsre->target, 1) != None) {
             // attempt to convert
-            to_property(x, sel, xse.requestor, xse.property, xsre->target);
+            to_property(x, data, cb, xse.requestor, xse.property, xsre->target);
         } else {
             // unknown target
             xse.property = None;
         }
-        neo_unlock(x);
+        neo_free(data);
     } else
         xse.property = None;
 
@@ -530,45 +800,68 @@ static void on_sel_request(neo_X* x, XSelectionRequestEvent* xsre)
 }
 
 
-#if defined(WITH_THREADS)
-// ClientMessage event handler
-static bool on_client_message(neo_X* x, XClientMessageEvent* xcme)
+#if defined(WITH_XFIXES)
+// XFixesSelectionNotify event handler
+static void on_owner_change(neo_X* x, XFixesSelectionNotifyEvent* xfsne)
 {
-    Atom param = (Atom)xcme->data.l[0];
-    int sel = atom2sel(x, param);
+    int sel = atom2sel(x, xfsne->selection);
 
-    if (xcme->message_type == x->atom[neo_ready]) {
-        // NEO_READY: fetch system selection
-        Window owner = XGetSelectionOwner(x->d, param);
-        if (owner == x->w) {
-            // no conversion needed
-            if (neo_lock(x)) {
-                neo_signal(x, sel);
-                neo_unlock(x);
+    // our data is valid unless selection was taken away
+    if (neo_lock(x)) {
+        x->owner[sel] = xfsne->owner;
+        x->since[sel] = xfsne->selection_timestamp;
+        x->f_valid[sel] = (xfsne->owner == x->w);
+        neo_unlock(x);
+    }
+
+    // fetch new selection in background
+    if (x->prefetch && xfsne->owner != x->w && xfsne->owner != None)
+        recv_start(x, sel, xfsne->owner, xfsne->timestamp);
+}
+#endif // WITH_XFIXES
+
+
+#if defined(WITH_THREADS)
+// read and execute commands from pipe
+// (return false) => stop thread
+static bool on_command(neo_X* x)
+{
+    neo_Cmd cmd;
+
+    while (read(x->fd[0], &cmd, sizeof(cmd)) == sizeof(cmd)) {
+        int sel = cmd.sel;
+
+        if (cmd.message == neo_ready) {
+            // fetch system selection
+            Window owner = XGetSelectionOwner(x->d, x->atom[sel]);
+            if (owner == x->w) {
+                // no conversion needed
+                if (neo_lock(x)) {
+                    neo_signal(x, sel);
+                    neo_unlock(x);
+                }
+            } else if (owner == None) {
+                // empty selection
+                neo_own(NULL, x, false, sel, NULL, 0, 0);
+            } else {
+                // what TARGETS are supported?
+                recv_start(x, sel, owner, cmd.time);
             }
-        } else if (owner == None) {
-            // empty selection
-            neo_own(x, false, sel, NULL, 0, 0);
-        } else {
-            // what TARGETS are supported?
-            XConvertSelection(x->d, param, x->atom[targets], x->atom[neo_ready], x->w,
-                (Time)xcme->data.l[1]);
-        }
-    } else if (xcme->message_type == x->atom[neo_offer]) {
-        // NEO_OFFER: offer our selection
-        XSetSelectionOwner(x->d, param, x->w, x->stamp[sel]);
-    } else if (xcme->message_type == x->atom[wm_proto] && param == x->atom[wm_dele]) {
-        // WM_DELETE_WINDOW
-        for (size_t i = 0; i < sel_total; ++i) {
-            if (XGetSelectionOwner(x->d, x->atom[i]) == x->w) {
-                // ask CLIPBOARD_MANAGER to SAVE_TARGETS first
-                XConvertSelection(x->d, x->atom[clipman], x->atom[save], None, x->w,
-                    (Time)xcme->data.l[1]);
-                return true;
+        } else if (cmd.message == neo_offer) {
+            // offer our selection
+            XSetSelectionOwner(x->d, x->atom[sel], x->w, x->stamp[sel]);
+        } else if (cmd.message == wm_dele) {
+            // quit
+            for (size_t i = 0; i < sel_total; ++i) {
+                if (XGetSelectionOwner(x->d, x->atom[i]) == x->w) {
+                    // ask CLIPBOARD_MANAGER to SAVE_TARGETS first
+                    XConvertSelection(x->d, x->atom[clipman], x->atom[save], None, x->w,
+                        cmd.time);
+                    return true;
+                }
             }
+            return false;
         }
-        // stop by WM_DELETE_WINDOW
-        return false;
     }
 
     return true;
@@ -576,23 +869,15 @@ static bool on_client_message(neo_X* x, XClientMessageEvent* xcme)
 #endif // WITH_THREADS
 
 
-// (re-)allocate data buffer for selection
+// replace data buffer for selection
 // Note: caller must acquire neo_lock() first
-static size_t alloc_data(neo_X* x, int sel, size_t cb)
+static void set_data(neo_X* x, int sel, uint8_t* data, size_t cb)
 {
-    if (cb > 0) {
-        void* ptr = realloc(x->data[sel], 1 + sizeof("utf-8") + cb);
-        if (ptr != NULL) {
-            x->data[sel] = ptr;
-            x->cb[sel] = cb;
-        }
-    } else {
-        free(x->data[sel]);
-        x->data[sel] = NULL;
-        x->cb[sel] = 0;
-    }
-
-    return x->cb[sel];
+    neo_free(x->data[sel]);
+    x->data[sel] = data;
+    x->cb[sel] = (data != NULL) ? cb : 0;
+    x->f_foreign[sel] = false;
+    x->used[sel] = now_ms();
 }
 
 
@@ -633,93 +918,538 @@ static Atom best_target(neo_X* x, Atom* atom, size_t count)
 
 
 #if defined(WITH_THREADS)
-// send ClientMessage to our thread
-static void client_message(neo_X* x, int message, int param)
+// send command to our thread
+// Note: pipe writes upto PIPE_BUF are atomic
+static void post_command(neo_X* x, int message, int sel)
 {
-    XClientMessageEvent xcme = {
-        .type = ClientMessage,
-        .display = x->d,
-        .window = x->w,
-        .message_type = x->atom[message],
-        .format = 32,
-        .data = {
-            .l = {
-                [0] = x->atom[param],
-                [1] = time_diff(x->delta),
-            },
-        },
+    neo_Cmd cmd = {
+        .message = message,
+        .sel = sel,
+        .time = time_diff(x->delta),
     };
-    XSendEvent(x->d, x->w, False, NoEventMask, (XEvent*)&xcme);
-    XFlush(x->d);
+    while (write(x->fd[1], &cmd, sizeof(cmd)) < 0 && errno == EINTR)
+        /*nothing*/;
 }
 #endif // WITH_THREADS
 
 
-// X11 predicate function: PropertyNotify/PropertyNewValue
-static Bool is_incr_notify(Display* d, XEvent* xe, XPointer arg)
+// start selection conversion: what TARGETS are supported?
+// repeat owner is asked for cached target at once (see tgt_add)
+// (does nothing if conversion is already in progress)
+// (is delayed while INCR chunks are discarded)
+static void recv_start(neo_X* x, int sel, Window owner, Time time)
+{
+    neo_Recv* r = &x->recv[sel];
+
+    if (r->drain) {
+        // old owner still writes to our property (see recv_next)
+        r->again = owner;
+        r->time = time;
+    } else if (!r->busy) {
+        bool multiple = false;
+        r->busy = true;
+        r->till = now_ms() + RECV_TIMEOUT;
+        if (neo_lock(x)) {
+            r->owner = x->owner[sel];
+            r->since = x->since[sel];
+            multiple = x->multiple;
+            neo_unlock(x);
+        }
+
+        Atom target = tgt_find(x, owner);
+        r->from = owner;
+        r->cached = (target != None);
+        if (target != None) {
+            // no TARGETS roundtrip
+            ++x->cached;
+            XConvertSelection(x->d, x->atom[sel], target, x->atom[neo_prim + sel],
+                x->w, time);
+        } else if (multiple) {
+            // ask TARGETS and best encodings in one roundtrip (see recv_multiple)
+            // atom pairs go to transfer property
+            Atom pair[] = {
+                x->atom[targets], x->atom[neo_multi + sel * 3],
+                x->atom[vimenc], x->atom[neo_multi + sel * 3 + 1],
+                x->atom[utf8_string], x->atom[neo_multi + sel * 3 + 2],
+            };
+            XChangeProperty(x->d, x->w, x->atom[neo_prim + sel], x->atom[atom_pair], 32,
+                PropModeReplace, (unsigned char*)pair, _countof(pair));
+            XConvertSelection(x->d, x->atom[sel], x->atom[multi],
+                x->atom[neo_prim + sel], x->w, time);
+        } else
+            XConvertSelection(x->d, x->atom[sel], x->atom[targets],
+                x->atom[neo_prim + sel], x->w, time);
+    }
+}
+
+
+// complete speculative MULTIPLE conversion
+// take best text that came at once, or else TARGETS, or else ask TARGETS again
+static void recv_multiple(neo_X* x, int sel, XSelectionEvent* xse)
 {
-    (void)d;    // unused
-    if (xe->type != PropertyNotify)
-        return False;
+    neo_Recv* r = &x->recv[sel];
+
+    // failed conversions have property replaced by None
+    Atom* pair = NULL;
+    unsigned long count = 0;
+    XGetWindowProperty(x->d, x->w, xse->property, 0, 6, True, AnyPropertyType,
+        &(Atom){None}, &(int){0}, &count, &(unsigned long){0}, (unsigned char**)&pair);
+
+    // property types are asked once and on demand
+    Atom type[3] = { None, None, None };
+    unsigned long size[3] = { 0, 0, 0 };
+    bool known[3] = { false, false, false };
+    count = (count < 6) ? count / 2 : 3;
+
+    // find best target that came with data (INCR is not handled here)
+    static const int order[] = { vimenc, utf8_string, targets };
+    size_t best = count;
+    for (size_t i = 0; i < _countof(order) && best == count; ++i) {
+        for (size_t j = 0; j < count; ++j) {
+            if (pair[2 * j] != x->atom[order[i]] || pair[2 * j + 1] == None)
+                continue;
+            type[j] = recv_type(x, pair[2 * j + 1], &size[j]);
+            known[j] = true;
+            if (type[j] != None && type[j] != x->atom[incr]) {
+                best = j;
+                if (order[i] != targets)
+                    tgt_add(x, r->from, pair[2 * j]);
+            }
+            break;
+        }
+    }
+
+    // drop the rest but INCR: deleting it would start the transfer
+    for (size_t j = 0; j < count; ++j) {
+        if (pair[2 * j + 1] == None || j == best)
+            continue;
+        if (!known[j])
+            type[j] = recv_type(x, pair[2 * j + 1], &size[j]);
+        if (type[j] != x->atom[incr])
+            XDeleteProperty(x->d, x->w, pair[2 * j + 1]);
+    }
+    Atom property = (best < count) ? pair[2 * best + 1] : None;
+    if (pair != NULL)
+        XFree(pair);
+
+    if (property != None) {
+        // text is done; TARGETS go on as usual (see recv_done)
+        recv_init(x, r, type[best], size[best], xse->time);
+        recv_property(x, r, property);
+        recv_done(x, sel, r);
+    } else {
+        // what TARGETS are supported?
+        XConvertSelection(x->d, x->atom[sel], x->atom[targets],
+            x->atom[neo_prim + sel], x->w, xse->time);
+        r->till = now_ms() + RECV_TIMEOUT;
+    }
+}
 
-    XPropertyEvent* xpe = &xe->xproperty;
-    XSelectionEvent* xse = (XSelectionEvent*)arg;
 
-    return (xpe->window == xse->requestor && xpe->atom == xse->property
-        && xpe->time >= xse->time && xpe->state == PropertyNewValue);
+// abort selection conversion
+static void recv_fail(neo_X* x, int sel)
+{
+    neo_Recv* r = &x->recv[sel];
+
+    neo_free(r->data);
+    r->data = NULL;
+    r->busy = r->incr = false;
+    r->trunc = false;
+    if (r->cached)
+        tgt_drop(x, r->from);
+    recv_cut(x, sel, r);
+    neo_own(NULL, x, false, sel, NULL, 0, 0);
 }
 
 
-#if defined(WITH_LUV)
-// run uv_loop until stop condition or time out
-static void modal_loop(lua_State* L, bool* stop, uint32_t timeout)
+// start selection transfer
+// property data is stored right into selection buffer
+static void recv_init(neo_X* x, neo_Recv* r, Atom type, size_t hint, Time time)
 {
-    lua_getfield(L, uv_share, "uv");    // uv or loop => stack
+    // abandon previous transfer
+    neo_free(r->data);
+    r->incr = false;
+
+    r->type = type;
+    r->time = time;
+    if (type == x->atom[vimenc])
+        r->base = 0;                    // type 'encoding' NUL text
+    else if (type == x->atom[vimtext])
+        r->base = sizeof("utf-8");      // type text
+    else
+        r->base = 1 + sizeof("utf-8");  // text
+
+    // cap data size unless TARGETS or asked for full text
+    r->limit = 0;
+    r->trunc = false;
+    if (type != x->atom[atom] && type != x->atom[targets] && neo_lock(x)) {
+        int sel = (int)(r - x->recv);
+        r->limit = x->f_full[sel] ? 0 : x->limit;
+        neo_unlock(x);
+    }
+    if (r->limit > 0 && r->base + hint > 1 + sizeof("utf-8") + r->limit)
+        hint = 1 + sizeof("utf-8") + r->limit - r->base;
+
+    // text is validated unless it needs conversion or it is not text at all
+    r->pos = r->base;
+    r->valid = 1 + sizeof("utf-8");
+    r->state = (type == x->atom[compound] || type == x->atom[string]
+        || type == x->atom[text] || type == x->atom[atom]
+        || type == x->atom[targets]) ? -1 : 0;
+
+    // preallocate for hint
+    r->size = r->base + hint;
+    if (r->size <= 1 + sizeof("utf-8"))
+        r->size = 1 + sizeof("utf-8") + 1;
+    r->data = neo_alloc(r->size - 1 - sizeof("utf-8"), MAUTO);
+    if (r->data == NULL)
+        r->size = 0;
+}
+
+
+// stop discarding INCR chunks and start delayed conversion (see recv_start)
+static void recv_resume(neo_X* x, int sel)
+{
+    neo_Recv* r = &x->recv[sel];
+    Window owner = r->again;
+
+    r->drain = false;
+    r->again = None;
+    if (owner != None)
+        recv_start(x, sel, owner, r->time);
+}
+
+
+// get type and size of our property
+// (return None) => no property
+static Atom recv_type(neo_X* x, Atom property, unsigned long* psize)
+{
+    Atom type = None;
+    unsigned char* xptr = NULL;
+
+    *psize = 0;
+    XGetWindowProperty(x->d, x->w, property, 0, 0, False, AnyPropertyType, &type,
+        &(int){0}, &(unsigned long){0}, psize, &xptr);
+    if (xptr != NULL)
+        XFree(xptr);
+
+    return type;
+}
+
+
+// receive next INCR chunk
+static void recv_next(neo_X* x, Atom property)
+{
+    for (size_t i = 0; i < sel_total; ++i) {
+        neo_Recv* r = &x->recv[i];
+        if (r->drain && property == x->atom[neo_prim + i]) {
+            // discard chunk until empty one
+            unsigned long size = 0;
+            recv_type(x, property, &size);
+            XDeleteProperty(x->d, x->w, property);
+            r->till = now_ms() + RECV_TIMEOUT;
+            if (size == 0)
+                recv_resume(x, i);
+            else if (r->again != None && neo_lock(x)) {
+                x->till[i] = r->till;
+                neo_unlock(x);
+            }
+            break;
+        } else if (r->incr && property == x->atom[neo_prim + i]) {
+            if (recv_property(x, r, property) == 0) {
+                // empty chunk: all done
+                recv_done(x, i, r);
+            } else if (r->trunc) {
+                // limit reached: owner goes on till empty chunk
+                r->drain = true;
+                r->again = None;
+                r->till = now_ms() + RECV_TIMEOUT;
+                recv_done(x, i, r);
+            } else {
+                // progress: extend deadlines
+                r->till = now_ms() + RECV_TIMEOUT;
+                if (neo_lock(x)) {
+                    x->till[i] = r->till;
+                    neo_unlock(x);
+                }
+            }
+            break;
+        }
+    }
+}
+
 
-    // local now, till = uv.now() + timeout
-    lua_Integer now, till;
-    lua_getfield(L, -1, "now");
-    lua_call(L, 0, 1);
-    till = lua_tointeger(L, -1) + timeout;
-    lua_pop(L, 1);
+// read our property by RECV_WINDOW and delete it
+// returns count of octets read
+static size_t recv_property(neo_X* x, neo_Recv* r, Atom property)
+{
+    size_t total = 0;
+    long offset = 0;
+    unsigned long after = 0;
 
-    // run nested loop
     do {
-        // uv.run"once"
-        lua_getfield(L, -1, "run");
-        lua_pushliteral(L, "once");
-        lua_call(L, 1, 0);
+        Atom type = None;
+        int format = 0;
+        unsigned long count = 0;
+        unsigned char* xptr = NULL;
+        if (XGetWindowProperty(x->d, x->w, property, offset, RECV_WINDOW, True,
+            AnyPropertyType, &type, &format, &count, &after, &xptr) != Success)
+            break;
 
-        // check stop condition
-        if (*stop)
+        // Xlib returns 32-bit items as long
+        size_t cb = count * (format == 32 ? sizeof(long) : format == 16 ? sizeof(short)
+            : 1);
+        if (!recv_append(r, xptr, cb) && after > 0) {
+            // out of memory or limit reached: drop the rest
+            XDeleteProperty(x->d, x->w, property);
+            after = 0;
+        }
+        offset += count * format / 32;
+        total += cb;
+
+        if (xptr != NULL)
+            XFree(xptr);
+    } while (after > 0);
+
+    return total;
+}
+
+
+// append data to selection transfer
+// stop on invalid UTF-8 as neo_split() would chop it anyway
+// (return false) => no more data wanted
+static bool recv_append(neo_Recv* r, const uint8_t* ptr, size_t cb)
+{
+    if (cb == 0 || r->valid == SIZE_MAX)
+        return true;
+
+    // cap text size (header is not counted)
+    if (r->limit > 0 && r->pos + cb > 1 + sizeof("utf-8") + r->limit) {
+        cb = 1 + sizeof("utf-8") + r->limit - r->pos;
+        r->trunc = true;
+    }
+
+    // grow buffer by half
+    if (r->pos + cb > r->size) {
+        size_t size = r->size + r->size / 2;
+        if (size < r->pos + cb)
+            size = r->pos + cb;
+        uint8_t* data = neo_realloc(r->data, size - 1 - sizeof("utf-8"));
+        if (data == NULL) {
+            r->valid = SIZE_MAX;
+            return false;
+        }
+        r->data = data;
+        r->size = size;
+    }
+
+    memcpy(r->data + r->pos, ptr, cb);
+    r->pos += cb;
+
+    // validate new text
+    if (r->state >= 0 && r->pos > r->valid) {
+        size_t cb_valid = neo_valid(r->data + r->valid, r->pos - r->valid, &r->state);
+        if (r->valid + cb_valid < r->pos) {
+            // truncate and stop
+            r->pos = r->valid + cb_valid;
+            r->valid = SIZE_MAX;
+        } else
+            r->valid = r->pos;
+    }
+
+    if (r->trunc) {
+        r->valid = SIZE_MAX;
+        return false;
+    }
+    return true;
+}
+
+
+// complete selection transfer
+static void recv_done(neo_X* x, int sel, neo_Recv* r)
+{
+    uint8_t* data = r->data;
+    size_t cb = (r->pos > 1 + sizeof("utf-8")) ? r->pos - 1 - sizeof("utf-8") : 0;
+
+    // transfer data ownership
+    r->data = NULL;
+    r->busy = r->incr = false;
+
+    // owner has changed meanwhile (XFixes): drop stale data
+    bool stale = false;
+    Window owner = None;
+    if (neo_lock(x)) {
+        stale = (r->owner != x->owner[sel] || r->since != x->since[sel]);
+        owner = x->owner[sel];
+        if (stale && owner == x->w)
+            neo_signal(x, sel);         // our data is there
+        neo_unlock(x);
+    }
+    if (stale) {
+        neo_free(data);
+        if (owner == None)
+            neo_own(NULL, x, false, sel, NULL, 0, 0);
+        else if (owner != x->w)
+            recv_start(x, sel, owner, time_diff(x->delta));
+        return;
+    }
+
+    do {
+        if (r->pos <= r->base) {
+            // nothing to do
+        } else if (r->type == x->atom[atom] || r->type == x->atom[targets]) {
+            // TARGETS: copy to aligned memory
+            size_t count = (r->pos - r->base) / sizeof(Atom);
+            Atom* tgt = malloc(count * sizeof(Atom));
+            Atom target = None;
+            if (tgt != NULL) {
+                memcpy(tgt, data + r->base, count * sizeof(Atom));
+                target = best_target(x, tgt, count);
+                free(tgt);
+            }
+            if (target != None) {
+                tgt_add(x, r->from, target);
+                XConvertSelection(x->d, x->atom[sel], target,
+                    x->atom[neo_prim + sel], x->w, r->time);
+                r->busy = true;
+                r->till = now_ms() + RECV_TIMEOUT;
+                neo_free(data);
+                return;
+            }
+        } else if (r->type == x->atom[vimenc]) {
+            // _VIMENC_TEXT
+            if (r->pos < 1 + sizeof("utf-8")
+                || memcmp(data + 1, "utf-8", sizeof("utf-8")) != 0) {
+                // no UTF-8; ask then for UTF8_STRING
+                XConvertSelection(x->d, x->atom[sel], x->atom[utf8_string],
+                    x->atom[neo_prim + sel], x->w, r->time);
+                r->busy = true;
+                r->till = now_ms() + RECV_TIMEOUT;
+                neo_free(data);
+                return;
+            }
+            break;
+        } else if (r->type == x->atom[vimtext]) {
+            // _VIM_TEXT: assume UTF-8
+            data[0] = data[sizeof("utf-8")];
+            data[sizeof("utf-8")] = 0;
+            break;
+        } else if (r->type == x->atom[plain_utf8] || r->type == x->atom[utf8_string]
+            || r->type == x->atom[plain]) {
+            // no conversion
+            data[0] = MAUTO;
             break;
+        } else if (r->type == x->atom[compound] || r->type == x->atom[string]
+            || r->type == x->atom[text]) {
+            // COMPOUND_TEXT, STRING or TEXT: attempt to convert to UTF-8
+            XTextProperty xtp = {
+                .value = data + r->base,
+                .encoding = r->type,
+                .format = 8,
+                .nitems = cb,
+            };
+            char** list;
+            if (Xutf8TextPropertyToTextList(x->d, &xtp, &list, &(int){0})
+                == Success) {
+                recv_cut(x, sel, r);
+                neo_own(NULL, x, false, sel, list[0], strlen(list[0]), MAUTO);
+                XFreeStringList(list);
+                neo_free(data);
+                return;
+            }
+        }
 
-        // now = uv.now()
-        lua_getfield(L, -1, "now");
-        lua_call(L, 0, 1);
-        now = lua_tointeger(L, -1);
-        lua_pop(L, 1);
-    } while (now < till);
+        // conversion failed
+        if (r->cached)
+            tgt_drop(x, r->from);
+        cb = 0;
+    } while (0);
+
+    // keep whole lines only
+    if (r->trunc && cb > 0)
+        cb = neo_cut(data + 1 + sizeof("utf-8"), cb);
+    recv_cut(x, sel, r);
+
+    if (cb == 0) {
+        neo_free(data);
+        data = NULL;
+    } else if (r->size > 1 + sizeof("utf-8") + cb) {
+        // shrink to fit
+        uint8_t* data2 = neo_realloc(data, cb);
+        if (data2 != NULL)
+            data = data2;
+    }
+    neo_take(NULL, x, false, sel, data, cb);
 
-    lua_pop(L, 1);                      // uv or loop <= stack
+    // data is up to date unless owner has changed meanwhile
+    if (x->xfixes != 0 && data != NULL && neo_lock(x)) {
+        x->f_valid[sel] = (r->owner == x->owner[sel] && r->since == x->since[sel]);
+        neo_unlock(x);
+    }
+}
+
+
+// publish whether selection transfer was cut at limit
+static void recv_cut(neo_X* x, int sel, neo_Recv* r)
+{
+    if (neo_lock(x)) {
+        x->f_trunc[sel] = r->trunc;
+        x->f_full[sel] = false;
+        neo_unlock(x);
+    }
+}
+
+
+#if defined(WITH_LUV)
+// dispatch X events until stop condition or deadline (may be extended meanwhile)
+// Note: uv_loop is not re-entered
+static void modal_loop(neo_X* x, bool* stop, Time* till)
+{
+    struct pollfd pfd = { .fd = XConnectionNumber(x->d), .events = POLLIN };
+    XEvent xe;
+
+    for (;;) {
+        // XPending also flushes output
+        while (!*stop && XPending(x->d) > 0) {
+            XNextEvent(x->d, &xe);
+            dispatch_event(x, &xe);
+        }
+
+        // check stop condition
+        Time now = now_ms();
+        if (*stop || now >= *till)
+            break;
+
+        // wait for X connection only
+        if (poll(&pfd, 1, (int)(*till - now)) < 0 && errno != EINTR)
+            break;
+    }
 }
 #endif // WITH_LUV
 
 
 // get ms difference from reference time
 static Time time_diff(Time ref)
+{
+    Time now = now_ms();
+    return (ref == CurrentTime || now == CurrentTime) ? CurrentTime : now - ref;
+}
+
+
+// get monotonic time in ms
+static Time now_ms(void)
 {
     struct timespec t;
 
-    if (ref == CurrentTime || clock_gettime(CLOCK_MONOTONIC, &t) < 0)
+    if (clock_gettime(CLOCK_MONOTONIC, &t) < 0)
         return CurrentTime;
 
-    return (t.tv_sec * 1000 + t.tv_nsec / 1000000) - ref;
+    return t.tv_sec * 1000 + t.tv_nsec / 1000000;
 }
 
 
 // process MULTIPLE selection requests
-static void to_multiple(neo_X* x, int sel, XSelectionEvent* xse)
+static void to_multiple(neo_X* x, uint8_t* data, size_t cb, XSelectionEvent* xse)
 {
     Atom* tgt = NULL;
     unsigned long ul_tgt = 0;
@@ -729,7 +1459,7 @@ static void to_multiple(neo_X* x, int sel, XSelectionEvent* xse)
 
     for (size_t i = 0; i < ul_tgt; i += 2)
         if (best_target(x, &tgt[i], 1) != None && tgt[i + 1] != None)
-            to_property(x, sel, xse->requestor, tgt[i + 1], tgt[i]);
+            to_property(x, data, cb, xse->requestor, tgt[i + 1], tgt[i]);
         else
             tgt[i + 1] = None;
 
@@ -741,58 +1471,241 @@ static void to_multiple(neo_X* x, int sel, XSelectionEvent* xse)
 }
 
 
-// put selection data into window property
-static void to_property(neo_X* x, int sel, Window w, Atom property, Atom type)
+// put selection data (see neo_peek) into window property
+// large data goes by INCR
+static void to_property(neo_X* x, uint8_t* data, size_t cb, Window w, Atom property,
+    Atom type)
 {
-    if (x->cb[sel] == 0) {
+    if (cb == 0) {
         XDeleteProperty(x->d, w, property);
         return;
     }
 
-    XTextProperty xtp = {
-        .value = (unsigned char*)x->data[sel],
-        .encoding = type,
-        .format = 8,
-        .nitems = (unsigned long)x->cb[sel],
+    neo_Send s = {
+        .w = w,
+        .property = property,
+        .type = type,
+        .value = data,
+        .cb = cb,
     };
-    unsigned char* ptr = NULL;
-    unsigned char* xptr = NULL;
 
     if (type == x->atom[vimenc]) {
         // _VIMENC_TEXT: type 'encoding' NUL text
-        xtp.nitems += 1 + sizeof("utf-8");
+        s.cb += 1 + sizeof("utf-8");
     } else if (type == x->atom[vimtext]) {
         // _VIM_TEXT: type text
-        ptr = malloc(1 + xtp.nitems);
-        if (ptr != NULL) {
-            ptr[0] = xtp.value[0];
-            memcpy(ptr + 1, xtp.value + 1 + sizeof("utf-8"), xtp.nitems);
-            xtp.value = ptr;
-            ++xtp.nitems;
+        s.ptr = malloc(1 + s.cb);
+        if (s.ptr != NULL) {
+            s.ptr[0] = s.value[0];
+            memcpy(s.ptr + 1, s.value + 1 + sizeof("utf-8"), s.cb);
+            s.value = s.ptr;
+            ++s.cb;
         }
     } else {
         // skip header
-        xtp.value += 1 + sizeof("utf-8");
+        s.value += 1 + sizeof("utf-8");
     }
 
     // Vim-alike behaviour: STRING == UTF8_STRING, TEXT == COMPOUND_TEXT
     if (type == x->atom[compound] || type == x->atom[text]) {
         // convert UTF-8 to COMPOUND_TEXT
-        ptr = malloc(xtp.nitems + 1);
-        if (ptr != NULL) {
-            memcpy(ptr, xtp.value, xtp.nitems);
-            ptr[xtp.nitems] = 0;
-            Xutf8TextListToTextProperty(x->d, (char**)&ptr, 1, XCompoundTextStyle, &xtp);
-            xptr = xtp.value;
+        char* str = malloc(s.cb + 1);
+        if (str != NULL) {
+            memcpy(str, s.value, s.cb);
+            str[s.cb] = 0;
+            XTextProperty xtp;
+            if (Xutf8TextListToTextProperty(x->d, &str, 1, XCompoundTextStyle, &xtp)
+                >= Success) {
+                s.value = s.xptr = xtp.value;
+                s.cb = xtp.nitems;
+            }
+            free(str);
         }
     }
 
-    // set property
-    XChangeProperty(x->d, w, property, type, xtp.format, PropModeReplace, xtp.value,
-        (int)xtp.nitems);
+    // set property or start INCR
+    if (s.cb <= x->chunk || !send_start(x, data, &s)) {
+        XChangeProperty(x->d, w, property, type, 8, PropModeReplace, s.value,
+            (int)s.cb);
+        free(s.ptr);
+        if (s.xptr != NULL)
+            XFree(s.xptr);
+    }
+}
+
 
-    // free memory
-    free(ptr);
-    if (xptr != NULL)
-        XFree(xptr);
+// start INCR transfer
+static bool send_start(neo_X* x, uint8_t* data, neo_Send* s)
+{
+    // find free slot
+    neo_Send* slot = NULL;
+    for (size_t i = 0; i < SEND_MAX && slot == NULL; ++i)
+        if (x->send[i].w == None)
+            slot = &x->send[i];
+    if (slot == NULL)
+        return false;
+
+    // keep selection data alive
+    *slot = *s;
+    slot->data = neo_ref(data);
+    slot->till = now_ms() + SEND_TIMEOUT;
+
+    // watch for PropertyDelete and DestroyNotify
+    XSelectInput(x->d, s->w, PropertyChangeMask | StructureNotifyMask);
+    long cb = (long)s->cb;
+    XChangeProperty(x->d, s->w, s->property, x->atom[incr], 32, PropModeReplace,
+        (unsigned char*)&cb, 1);
+    return true;
+}
+
+
+// send next INCR chunk
+static void send_next(neo_X* x, Window w, Atom property)
+{
+    for (size_t i = 0; i < SEND_MAX; ++i) {
+        neo_Send* s = &x->send[i];
+        if (s->w == w && s->property == property) {
+            size_t cb = s->cb - s->off;
+            if (cb > x->chunk)
+                cb = x->chunk;
+
+            XChangeProperty(x->d, w, property, s->type, 8, PropModeReplace,
+                s->value + s->off, (int)cb);
+            s->off += cb;
+            s->till = now_ms() + SEND_TIMEOUT;
+
+            // zero-length chunk terminates transfer
+            if (cb == 0)
+                send_end(x, s);
+            break;
+        }
+    }
+}
+
+
+// end INCR transfer and free its slot
+static void send_end(neo_X* x, neo_Send* s)
+{
+    Window w = s->w;
+
+    neo_free(s->data);
+    free(s->ptr);
+    if (s->xptr != NULL)
+        XFree(s->xptr);
+    s->w = None;
+
+    // stop watching requestor if it's done
+    for (size_t i = 0; i < SEND_MAX; ++i)
+        if (x->send[i].w == w)
+            return;
+    XSelectInput(x->d, w, (tgt_find(x, w) != None) ? StructureNotifyMask : NoEventMask);
+}
+
+
+// drop stalled transfers and trim idle foreign data
+// returns ms till next deadline (-1 => none)
+static int expire(neo_X* x)
+{
+    Time now = now_ms();
+    int timeout = -1;
+
+    for (size_t i = 0; i < sel_total; ++i) {
+        neo_Recv* r = &x->recv[i];
+        if (!r->busy && !r->incr && !r->drain) {
+            // not in progress
+        } else if (r->till <= now && r->drain) {
+            // old owner has gone silent
+            recv_resume(x, i);
+            if (r->busy && (timeout < 0 || r->till - now < (Time)timeout))
+                timeout = (int)(r->till - now);
+        } else if (r->till <= now) {
+            // owner has gone silent
+            recv_fail(x, i);
+        } else if (timeout < 0 || r->till - now < (Time)timeout) {
+            timeout = (int)(r->till - now);
+        }
+    }
+
+    for (size_t i = 0; i < SEND_MAX; ++i) {
+        neo_Send* s = &x->send[i];
+        if (s->w == None) {
+            // unused
+        } else if (s->till <= now) {
+            send_end(x, s);
+        } else if (timeout < 0 || s->till - now < (Time)timeout) {
+            timeout = (int)(s->till - now);
+        }
+    }
+
+    // trim idle foreign selections
+    if (x->trim > 0 && neo_lock(x)) {
+        for (size_t i = 0; i < sel_total; ++i) {
+            if (!x->f_foreign[i]) {
+                // nothing to trim
+            } else if (x->used[i] + x->trim <= now) {
+                // fetch again on demand
+                set_data(x, i, NULL, 0);
+                x->f_valid[i] = false;
+            } else if (timeout < 0 || x->used[i] + x->trim - now < (Time)timeout) {
+                timeout = (int)(x->used[i] + x->trim - now);
+            }
+        }
+        neo_unlock(x);
+    }
+
+    return timeout;
+}
+
+
+// find best target cached for owner
+// (return None) => not cached
+static Atom tgt_find(neo_X* x, Window owner)
+{
+    for (size_t i = 0; owner != None && i < TGT_MAX; ++i)
+        if (x->tgt[i].owner == owner)
+            return x->tgt[i].target;
+    return None;
+}
+
+
+// cache best target for owner
+// watch for DestroyNotify to drop it
+static void tgt_add(neo_X* x, Window owner, Atom target)
+{
+    if (owner == None)
+        return;
+
+    neo_Tgt* t = NULL;
+    for (size_t i = 0; i < TGT_MAX && t == NULL; ++i)
+        if (x->tgt[i].owner == owner)
+            t = &x->tgt[i];
+
+    if (t == NULL) {
+        // reuse oldest slot
+        t = &x->tgt[x->tgt_next];
+        x->tgt_next = (x->tgt_next + 1) % TGT_MAX;
+        if (t->owner != None) {
+            bool busy = false;
+            for (size_t i = 0; i < SEND_MAX && !busy; ++i)
+                busy = (x->send[i].w == t->owner);
+            if (!busy)
+                XSelectInput(x->d, t->owner, NoEventMask);
+        }
+        t->owner = owner;
+        bool busy = false;
+        for (size_t i = 0; i < SEND_MAX && !busy; ++i)
+            busy = (x->send[i].w == owner);
+        XSelectInput(x->d, owner, busy ? PropertyChangeMask | StructureNotifyMask
+            : StructureNotifyMask);
+    }
+    t->target = target;
+}
+
+
+// forget best target for owner
+static void tgt_drop(neo_X* x, Window owner)
+{
+    for (size_t i = 0; owner != None && i < TGT_MAX; ++i)
+        if (x->tgt[i].owner == owner)
+            x->tgt[i].owner = None;
 }
@@ -1,6 +1,6 @@
 /*
  * neoclip - Neovim clipboard provider
- * Last Change:  2025 Jun 21
+ * Last Change:  2026 Oct 16
  * License:      https://unlicense.org
  * URL:          https://github.com/matveyt/neoclip
  */
@@ -13,6 +13,10 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 
+#if defined(WITH_XFIXES)
+#include <X11/extensions/Xfixes.h>
+#endif // WITH_XFIXES
+
 #if defined(WITH_THREADS)
 #include <pthread.h>
 #endif // WITH_THREADS
@@ -33,6 +37,13 @@ enum {
     wm_dele,            // WM_DELETE_WINDOW
     neo_ready,          // NEO_READY
     neo_offer,          // NEO_OFFER
+    // transfer property per selection
+    neo_prim,           // NEO_PRIMARY
+    neo_sec,            // NEO_SECONDARY
+    neo_clip,           // NEO_CLIPBOARD
+    // MULTIPLE properties per selection: TARGETS, _VIMENC_TEXT, UTF8_STRING
+    neo_multi,          // NEO_PRIMARY_TARGETS
+    neo_multi_end = neo_multi + sel_total * 3 - 1,
     // supported targets
     targets,            // TARGETS
     dele,               // DELETE
@@ -52,6 +63,71 @@ enum {
     total
 };
 
+// property read window (in 32-bit units)
+#define RECV_WINDOW 0x40000
+// max selection owner delay (ms)
+#define RECV_TIMEOUT 1000
+
+// selection transfer in progress
+typedef struct {
+    Atom type;                          // property type
+    uint8_t* data;                      // _VIMENC_TEXT (see neo_alloc)
+    size_t size;                        // allocated size (header included)
+    size_t base;                        // offset of property data
+    size_t pos;                         // current write offset
+    size_t valid;                       // UTF-8 validated upto (SIZE_MAX => stopped)
+    int state;                          // UTF-8 validator state (< 0 => disabled)
+    Time time;                          // conversion time stamp
+    Time till;                          // conversion deadline (monotonic ms)
+    Window owner;                       // owner at conversion start
+    Time since;                         // owner time stamp at conversion start
+    size_t limit;                       // max. text size (0 => unlimited)
+    bool trunc;                         // data was cut at limit
+    Window from;                        // owner asked (TARGETS cache key)
+    bool cached;                        // target is taken from cache
+    bool busy;                          // conversion in progress
+    bool incr;                          // INCR in progress
+    bool drain;                         // INCR: discard chunks after limit
+    Window again;                       // owner to ask after drain (None => none)
+} neo_Recv;
+
+// TARGETS cache size
+#define TGT_MAX 8
+
+// best target negotiated with selection owner
+typedef struct {
+    Window owner;                       // owner window (None => unused)
+    Atom target;                        // best target
+} neo_Tgt;
+
+// INCR transfer limits
+#define SEND_CHUNK 0x100000             // max chunk size (octets)
+#define SEND_MAX 16                     // max concurrent transfers
+#define SEND_TIMEOUT 5000               // max requestor delay (ms)
+
+// INCR transfer to requestor
+typedef struct {
+    Window w;                           // requestor window (None => unused)
+    Atom property;                      // requestor property
+    Atom type;                          // property type
+    const unsigned char* value;         // data to send
+    size_t cb;                          // data size
+    size_t off;                         // data sent
+    uint8_t* data;                      // referenced selection data (see neo_ref)
+    unsigned char* ptr;                 // malloc()'ed data
+    unsigned char* xptr;                // XFree()'d data
+    Time till;                          // deadline (monotonic ms)
+} neo_Send;
+
+#if defined(WITH_THREADS)
+// command to our thread
+typedef struct {
+    int message;                        // neo_ready, neo_offer or wm_dele
+    int sel;                            // selection index
+    Time time;                          // time stamp
+} neo_Cmd;
+#endif // WITH_THREADS
+
 // driver state
 struct neo_X {
     Display* d;                         // X Display
@@ -62,35 +138,84 @@ struct neo_X {
     size_t cb[sel_total];               // Selection: text size only
     Time stamp[sel_total];              // Selection: time stamp
     bool f_rdy[sel_total];              // Selection: "ready" flag
+    Time till[sel_total];               // Selection: fetch deadline (monotonic ms)
+    neo_Recv recv[sel_total];           // Selection: transfer in progress
+    Window owner[sel_total];            // Selection: current owner (XFixes)
+    Time since[sel_total];              // Selection: owner time stamp (XFixes)
+    bool f_valid[sel_total];            // Selection: data is up to date (XFixes)
+    bool f_foreign[sel_total];          // Selection: data came from other client
+    Time used[sel_total];               // Selection: last access (monotonic ms)
+    Time trim;                          // trim idle foreign data after ms (0 => never)
+    bool f_trunc[sel_total];            // Selection: data was cut at limit
+    bool f_full[sel_total];             // Selection: fetch ignoring limit
+    size_t limit;                       // max. text size to fetch (0 => unlimited)
+    int xfixes;                         // XFixes event base (0 => not tracking)
+    bool prefetch;                      // fetch selection upon owner change
+    bool multiple;                      // ask TARGETS and text by one MULTIPLE
+    size_t chunk;                       // INCR chunk size
+    neo_Send send[SEND_MAX];            // INCR transfers
+    neo_Tgt tgt[TGT_MAX];               // TARGETS cache
+    size_t tgt_next;                    // next cache slot to reuse
+    size_t cached;                      // conversions with cached target
 #if defined(WITH_THREADS)
     pthread_cond_t c_rdy[sel_total];    // Selection: "ready" condition
     pthread_mutex_t lock;               // Mutex lock
     pthread_t tid;                      // Thread ID
+    int fd[2];                          // Command pipe
 #endif // WITH_THREADS
+#if defined(WITH_LUV)
+    Time timer;                         // timer deadline (0 => stopped)
+    size_t polls;                       // poll callbacks
+    size_t timers;                      // timer callbacks
+#endif // WITH_LUV
 };
 
+static int on_error(Display* d, XErrorEvent* xee);
 static bool dispatch_event(neo_X* x, XEvent* xe);
 static void on_sel_notify(neo_X* x, XSelectionEvent* xse);
 static void on_sel_request(neo_X* x, XSelectionRequestEvent* xsre);
-static size_t alloc_data(neo_X* x, int sel, size_t cb);
+#if defined(WITH_XFIXES)
+static void on_owner_change(neo_X* x, XFixesSelectionNotifyEvent* xfsne);
+#endif // WITH_XFIXES
+static void set_data(neo_X* x, int sel, uint8_t* data, size_t cb);
 static void ask_timestamp(neo_X* x);
 static int atom2sel(neo_X* x, Atom atom);
 static Atom best_target(neo_X* x, Atom* atom, size_t count);
-static Bool is_incr_notify(Display* d, XEvent* xe, XPointer arg);
+static void recv_start(neo_X* x, int sel, Window owner, Time time);
+static void recv_multiple(neo_X* x, int sel, XSelectionEvent* xse);
+static void recv_fail(neo_X* x, int sel);
+static void recv_init(neo_X* x, neo_Recv* r, Atom type, size_t hint, Time time);
+static Atom recv_type(neo_X* x, Atom property, unsigned long* psize);
+static void recv_next(neo_X* x, Atom property);
+static void recv_resume(neo_X* x, int sel);
+static size_t recv_property(neo_X* x, neo_Recv* r, Atom property);
+static bool recv_append(neo_Recv* r, const uint8_t* ptr, size_t cb);
+static void recv_done(neo_X* x, int sel, neo_Recv* r);
+static void recv_cut(neo_X* x, int sel, neo_Recv* r);
 static Time time_diff(Time ref);
-static void to_multiple(neo_X* x, int sel, XSelectionEvent* xse);
-static void to_property(neo_X* x, int sel, Window w, Atom property, Atom type);
+static Time now_ms(void);
+static bool send_start(neo_X* x, uint8_t* data, neo_Send* s);
+static void send_next(neo_X* x, Window w, Atom property);
+static void send_end(neo_X* x, neo_Send* s);
+static int expire(neo_X* x);
+static Atom tgt_find(neo_X* x, Window owner);
+static void tgt_add(neo_X* x, Window owner, Atom target);
+static void tgt_drop(neo_X* x, Window owner);
+static void to_multiple(neo_X* x, uint8_t* data, size_t cb, XSelectionEvent* xse);
+static void to_property(neo_X* x, uint8_t* data, size_t cb, Window w, Atom property,
+    Atom type);
 
 #if defined(WITH_LUV)
-static int cb_prepare(lua_State* L);
 static int cb_poll(lua_State* L);
-static void modal_loop(lua_State* L, bool* stop, uint32_t timeout);
+static int cb_timer(lua_State* L);
+static void settle(neo_X* x, lua_State* L);
+static void modal_loop(neo_X* x, bool* stop, Time* till);
 #endif // WITH_LUV
 
 #if defined(WITH_THREADS)
 static void* thread_main(void* X);
-static bool on_client_message(neo_X* X, XClientMessageEvent* xcme);
-static void client_message(neo_X* x, int message, int param);
+static bool on_command(neo_X* x);
+static void post_command(neo_X* x, int message, int sel);
 #endif // WITH_THREADS
 
 
@@ -116,6 +241,7 @@ static inline bool neo_unlock(neo_X* x)
 static inline bool neo_signal(neo_X* x, int sel)
 {
     x->f_rdy[sel] = true;
+    neo_notify(sel);
 #if defined(WITH_THREADS)
     return (pthread_cond_signal(&x->c_rdy[sel]) == 0);
 #else
@@ -1,6 +1,6 @@
 /*
  * neoclip - Neovim clipboard provider
- * Last Change:  2025 Jun 20
+ * Last Change:  2026 Oct 16
  * License:      https://unlicense.org
  * URL:          https://github.com/matveyt/neoclip
  */
@@ -40,12 +40,17 @@ enum {
 // userdata : incomplete type
 typedef struct neo_UD neo_UD;
 
+// selection data consumer, e.g. neo_split or neo_raw
+typedef void (*neo_Reader)(lua_State* L, int ix, const void* data, size_t cb, int type);
+
 // API implementation
 int neo_start(lua_State* L);    // lua_CFunction() => nil or error
 int neo_stop(lua_State* L);     // lua_CFunction() => nil
 int neo_status(lua_State* L);   // lua_CFunction() => boolean
 int neo_get(lua_State* L);      // lua_CFunction(reg) => {string_array, type}
 int neo_set(lua_State* L);      // lua_CFunction(reg, string_array, type) => boolean
+int neo_get_raw(lua_State* L);  // lua_CFunction(reg) => string, type
+int neo_set_raw(lua_State* L);  // lua_CFunction(reg, string, type) => boolean
 int neo__gc(lua_State* L);      // destroy state
 
 // neo_common.c
@@ -53,7 +58,11 @@ int neo_id(lua_State* L);       // lua_CFunction(uv_module) => string
 int neo_nil(lua_State* L);      // lua_CFunction() => nil
 int neo_true(lua_State* L);     // lua_CFunction() => true
 void neo_join(lua_State* L, int ix, const char* sep);
+size_t neo_join_buf(lua_State* L, int ix, const char* sep, void* buf);
 void neo_split(lua_State* L, int ix, const void* data, size_t cb, int type);
+void neo_raw(lua_State* L, int ix, const void* data, size_t cb, int type);
+size_t neo_scan(const void* data, size_t cb, size_t** plf, size_t* pcount);
+size_t neo_valid(const void* data, size_t cb, int* pstate);
 void neo_inspect(lua_State* L, int ix);                 // debug only
 void neo_printf(lua_State* L, const char* fmt, ...);    // debug only
 
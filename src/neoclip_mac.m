@@ -1,6 +1,6 @@
 /*
  * neoclip - Neovim clipboard provider
- * Last Change:  2025 Jun 21
+ * Last Change:  2026 Oct 16
  * License:      https://unlicense.org
  * URL:          https://github.com/matveyt/neoclip
  */
@@ -14,6 +14,11 @@
 static NSString* VimPboardType = @"VimPboardType";
 
 
+// forward prototypes
+static void get_pboard(lua_State* L, neo_Reader fn);
+static bool set_pboard(const char* ptr, size_t cb, int type);
+
+
 // module registration
 __attribute__((visibility("default")))
 int luaopen_driver(lua_State* L)
@@ -25,6 +30,8 @@ int luaopen_driver(lua_State* L)
         { "status", neo_true },
         { "get", neo_get },
         { "set", neo_set },
+        { "get_raw", neo_get_raw },
+        { "set_raw", neo_set_raw },
         { NULL, NULL }
     };
 
@@ -52,7 +59,68 @@ int neo_get(lua_State* L)
 
     // a table to return
     lua_createtable(L, 2, 0);
+    get_pboard(L, neo_split);
+
+    // always return table (empty on error)
+    return 1;
+}
+
+
+// get_raw(regname) => string, regtype
+int neo_get_raw(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TSTRING);  // regname (unused)
+
+    // [string, regtype]
+    lua_createtable(L, 2, 0);
+    get_pboard(L, neo_raw);
+
+    // nil on error
+    lua_rawgeti(L, -1, 1);
+    lua_rawgeti(L, -2, 2);
+    return 2;
+}
+
+
+// set(regname, lines, regtype) => boolean
+int neo_set(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TSTRING);  // regname (unused)
+    luaL_checktype(L, 2, LUA_TTABLE);   // lines
+    luaL_checktype(L, 3, LUA_TSTRING);  // regtype
+    int type = neo_type(*lua_tostring(L, 3));
+
+    // table to string
+    neo_join(L, 2, "\n");
+
+    // get UTF-8
+    size_t cb;
+    const char* ptr = lua_tolstring(L, -1, &cb);
+
+    lua_pushboolean(L, set_pboard(ptr, cb, type));
+    return 1;
+}
+
+
+// set_raw(regname, string, regtype) => boolean
+int neo_set_raw(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TSTRING);  // regname (unused)
+    luaL_checktype(L, 2, LUA_TSTRING);  // string
+    luaL_checktype(L, 3, LUA_TSTRING);  // regtype
+    int type = neo_type(*lua_tostring(L, 3));
+
+    size_t cb;
+    const char* ptr = lua_tolstring(L, 2, &cb);
+
+    lua_pushboolean(L, set_pboard(ptr, cb, type));
+    return 1;
+}
 
+
+// read pasteboard and pass UTF-8 text to reader function
+static void get_pboard(lua_State* L, neo_Reader fn)
+{
     // check supported types
     NSPasteboard* pb = [NSPasteboard generalPasteboard];
     NSString* bestType = [pb availableTypeFromArray:[NSArray
@@ -75,32 +143,17 @@ int neo_get(lua_State* L)
         if (str == nil)
             str = [pb stringForType:NSPasteboardTypeString];
 
-        // convert to UTF-8 and split into table
+        // convert to UTF-8 and pass to reader
         NSData* buf = [str dataUsingEncoding:NSUTF8StringEncoding];
         if (buf.length > 0)
-            neo_split(L, -1, buf.bytes, buf.length, type);
+            fn(L, -1, buf.bytes, buf.length, type);
     }
-
-    // always return table (empty on error)
-    return 1;
 }
 
 
-// set(regname, lines, regtype) => boolean
-int neo_set(lua_State* L)
+// set pasteboard from UTF-8 text
+static bool set_pboard(const char* ptr, size_t cb, int type)
 {
-    luaL_checktype(L, 1, LUA_TSTRING);  // regname (unused)
-    luaL_checktype(L, 2, LUA_TTABLE);   // lines
-    luaL_checktype(L, 3, LUA_TSTRING);  // regtype
-    int type = neo_type(*lua_tostring(L, 3));
-
-    // table to string
-    neo_join(L, 2, "\n");
-
-    // get UTF-8
-    size_t cb;
-    const char* ptr = lua_tolstring(L, -1, &cb);
-
     // convert UTF-8 to NSString
     NSString* str = [[NSString alloc] initWithBytes:ptr length:cb
         encoding:NSUTF8StringEncoding];
@@ -116,6 +169,5 @@ int neo_set(lua_State* L)
     // cleanup
     [str release];
 
-    lua_pushboolean(L, success);
-    return 1;
+    return success;
 }
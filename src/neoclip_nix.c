@@ -1,12 +1,51 @@
 /*
  * neoclip - Neovim clipboard provider
- * Last Change:  2025 Jun 21
+ * Last Change:  2026 Oct 16
  * License:      https://unlicense.org
  * URL:          https://github.com/matveyt/neoclip
  */
 
 
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif // __linux__
 #include "neoclip_nix.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+// get_async default timeout (ms)
+#define ASYNC_TIMEOUT 1000
+
+
+// selection data header (see neo_alloc)
+typedef struct {
+    size_t ref;     // reference count
+    size_t size;    // allocated size (header included)
+    int fd;         // memfd (-1 => heap)
+} neo_Head;
+
+
+// driver state for LuaJIT FFI
+neo_X* neo_ffi_x = NULL;
+// selection size to store in memfd (0 => never)
+size_t neo_memfd_min = MEMFD_MIN;
+// get_async notification pipe and waiters count
+static int neo_pipe[2] = { -1, -1 };
+static int neo_wait[sel_total];
+
+
+static bool async_init(lua_State* L);
+static bool async_drop(lua_State* L, int ix);
+static int async_cancel(lua_State* L);
+static int cb_expire(lua_State* L);
+static int cb_notify(lua_State* L);
+static void push_uv(lua_State* L);
+static void push_wait(lua_State* L, int sel);
+static void push_closure(lua_State* L, lua_CFunction fn, int ix);
+static neo_Head* map_alloc(neo_Head* head, size_t size);
 
 
 // module registration
@@ -20,6 +59,12 @@ int luaopen_driver(lua_State* L)
         { "status", neo_status },
         { "get", neo_get },
         { "set", neo_set },
+        { "get_raw", neo_get_raw },
+        { "set_raw", neo_set_raw },
+        { "fetch", neo_update },
+        { "stats", neo_stats },
+        { "get_async", neo_get_async },
+        { "get_many", neo_get_many },
         { NULL, NULL }
     };
 
@@ -63,21 +108,111 @@ int neo_status(lua_State* L)
 }
 
 
-// get(regname) => [lines, regtype]
+// get driver counters
+int neo_stats(lua_State* L)
+{
+    neo_X* x = neo_x(L);
+    if (x != NULL) {
+        lua_newtable(L);
+        neo_count(x, L);
+    } else
+        lua_pushnil(L);
+    return 1;
+}
+
+
+// get(regname [, full]) => [lines, regtype, truncated = true]
 int neo_get(lua_State* L)
 {
     luaL_checktype(L, 1, LUA_TSTRING);  // regname
     int sel = (*lua_tostring(L, 1) == '*') ? sel_prim : sel_clip;
+    int flags = lua_toboolean(L, 2) ? fetch_full : 0;
 
     // a table to return
     lua_createtable(L, 2, 0);
-    neo_fetch(L, -1, sel);
+    if (neo_fetch(L, -1, sel, flags, neo_split)) {
+        lua_pushboolean(L, 1);
+        lua_setfield(L, -2, "truncated");
+    }
 
     // always return table (empty on error)
     return 1;
 }
 
 
+// get_raw(regname [, full]) => string, regtype, truncated
+int neo_get_raw(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TSTRING);  // regname
+    int sel = (*lua_tostring(L, 1) == '*') ? sel_prim : sel_clip;
+    int flags = lua_toboolean(L, 2) ? fetch_full : 0;
+
+    // [string, regtype]
+    lua_createtable(L, 2, 0);
+    bool truncated = neo_fetch(L, -1, sel, flags, neo_raw);
+
+    // nil on error
+    lua_rawgeti(L, -1, 1);
+    lua_rawgeti(L, -2, 2);
+    lua_pushboolean(L, truncated);
+    return 3;
+}
+
+
+// fetch(regname [, full]) => boolean
+// update selection data for neoclip_acquire()
+int neo_update(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TSTRING);  // regname
+    int sel = (*lua_tostring(L, 1) == '*') ? sel_prim : sel_clip;
+
+    neo_fetch(L, 0, sel, lua_toboolean(L, 2) ? fetch_full : 0, NULL);
+
+    lua_pushboolean(L, neo_x(L) != NULL);
+    return 1;
+}
+
+
+// get_many(regnames) => [[lines, regtype], ...]
+// all requests are sent before waiting for any
+int neo_get_many(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);   // regnames
+    int count = (int)lua_objlen(L, 1);
+    bool sent[sel_total] = { false };
+
+    // start fetching
+    for (int i = 1; i <= count; ++i) {
+        lua_rawgeti(L, 1, i);
+        const char* reg = lua_tostring(L, -1);
+        int sel = (reg != NULL && *reg == '*') ? sel_prim : sel_clip;
+        lua_pop(L, 1);
+        if (!sent[sel] && neo_x(L) != NULL) {
+            neo_request(L, sel);
+            sent[sel] = true;
+        }
+    }
+
+    // wait for each
+    lua_createtable(L, count, 0);
+    for (int i = 1; i <= count; ++i) {
+        lua_rawgeti(L, 1, i);
+        const char* reg = lua_tostring(L, -1);
+        int sel = (reg != NULL && *reg == '*') ? sel_prim : sel_clip;
+        lua_pop(L, 1);
+
+        lua_createtable(L, 2, 0);
+        if (neo_fetch(L, -1, sel, sent[sel] ? fetch_sent : 0, neo_split)) {
+            lua_pushboolean(L, 1);
+            lua_setfield(L, -2, "truncated");
+        }
+        lua_rawseti(L, -2, i);
+    }
+
+    return 1;
+}
+
+
 // set(regname, lines, regtype) => boolean
 int neo_set(lua_State* L)
 {
@@ -89,14 +224,538 @@ int neo_set(lua_State* L)
 
     neo_X* x = neo_x(L);
     if (x != NULL) {
-        // change selection data
-        neo_join(L, 2, "\n");
+        // join lines straight into new selection data
+        size_t cb = neo_join_buf(L, 2, "\n", NULL);
+        uint8_t* data = neo_alloc(cb, type);
+        if (data != NULL)
+            neo_join_buf(L, 2, "\n", data + 1 + sizeof("utf-8"));
+        neo_take(L, x, true, sel, data, cb);
+    }
+
+    lua_pushboolean(L, x != NULL);
+    return 1;
+}
+
 
+// set_raw(regname, string, regtype) => boolean
+int neo_set_raw(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TSTRING);  // regname
+    luaL_checktype(L, 2, LUA_TSTRING);  // string
+    luaL_checktype(L, 3, LUA_TSTRING);  // regtype
+    int sel = (*lua_tostring(L, 1) == '*') ? sel_prim : sel_clip;
+    int type = neo_type(*lua_tostring(L, 3));
+
+    neo_X* x = neo_x(L);
+    if (x != NULL) {
+        // change selection data
         size_t cb;
-        const char* ptr = lua_tolstring(L, -1, &cb);
-        neo_own(x, true, sel, ptr, cb, type);
+        const char* ptr = lua_tolstring(L, 2, &cb);
+        neo_own(L, x, true, sel, ptr, cb, type);
     }
 
     lua_pushboolean(L, x != NULL);
     return 1;
 }
+
+
+// get_async(regname, callback [, timeout]) => cancel function
+// callback(lines, regtype) is called from uv_loop; (nil, nil) on timeout
+int neo_get_async(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TSTRING);      // regname
+    luaL_checktype(L, 2, LUA_TFUNCTION);    // callback
+    int timeout = luaL_optinteger(L, 3, ASYNC_TIMEOUT);
+    int sel = (*lua_tostring(L, 1) == '*') ? sel_prim : sel_clip;
+    lua_settop(L, 2);
+
+    if (neo_x(L) == NULL || !async_init(L)) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    // local req = { cb = callback, sel = sel, timer = uv.new_timer() }
+    lua_createtable(L, 0, 3);               // req => stack (3)
+    lua_pushvalue(L, 2);
+    lua_setfield(L, 3, "cb");
+    lua_pushinteger(L, sel);
+    lua_setfield(L, 3, "sel");
+    push_uv(L);                             // uv => stack (4)
+    lua_getfield(L, 4, "new_timer");
+    lua_call(L, 0, 1);
+    lua_setfield(L, 3, "timer");
+
+    // uv.timer_start(req.timer, timeout, 0, cb_expire)
+    lua_getfield(L, 4, "timer_start");
+    lua_getfield(L, 3, "timer");
+    lua_pushinteger(L, timeout);
+    lua_pushinteger(L, 0);
+    push_closure(L, cb_expire, 3);
+    lua_call(L, 4, 0);
+    lua_pop(L, 1);                          // uv <= stack
+
+    // uv_share.wait[sel][req] = true
+    push_wait(L, sel);
+    lua_pushvalue(L, 3);
+    lua_pushboolean(L, 1);
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
+    __atomic_add_fetch(&neo_wait[sel], 1, __ATOMIC_RELEASE);
+
+    // start fetching; notify now if it is already there
+    if (neo_request(L, sel))
+        neo_notify(sel);
+
+    push_closure(L, async_cancel, 3);
+    return 1;
+}
+
+
+// allocate selection data buffer
+// _VIMENC_TEXT: type 'encoding' NUL text
+// Note: header is stored just before data
+// large data goes to memfd, so it can be paged out or spliced
+// (cb == 0) => NULL
+uint8_t* neo_alloc(size_t cb, int type)
+{
+    if (cb == 0)
+        return NULL;
+
+    size_t size = sizeof(neo_Head) + 1 + sizeof("utf-8") + cb;
+    neo_Head* head = (neo_memfd_min > 0 && cb >= neo_memfd_min) ?
+        map_alloc(NULL, size) : NULL;
+    if (head == NULL) {
+        head = malloc(size);
+        if (head == NULL)
+            return NULL;
+        head->fd = -1;
+    }
+
+    uint8_t* data = (uint8_t*)(head + 1);
+    head->ref = 1;
+    head->size = size;
+    data[0] = type;
+    memcpy(data + 1, "utf-8", sizeof("utf-8"));
+
+    return data;
+}
+
+
+// resize selection data buffer (must not be shared)
+// (data == NULL) => neo_alloc(cb, MAUTO)
+uint8_t* neo_realloc(uint8_t* data, size_t cb)
+{
+    if (data == NULL)
+        return neo_alloc(cb, MAUTO);
+
+    neo_Head* head = (neo_Head*)data - 1;
+    size_t size = sizeof(neo_Head) + 1 + sizeof("utf-8") + cb;
+    if (head->fd >= 0 || (neo_memfd_min > 0 && cb >= neo_memfd_min)) {
+        neo_Head* head2 = map_alloc(head, size);
+        if (head2 != NULL)
+            return (uint8_t*)(head2 + 1);
+        if (head->fd >= 0)
+            return NULL;
+    }
+
+    head = realloc(head, size);
+    if (head == NULL)
+        return NULL;
+    head->size = size;
+    return (uint8_t*)(head + 1);
+}
+
+
+// add reference to selection data
+uint8_t* neo_ref(uint8_t* data)
+{
+    if (data != NULL)
+        __atomic_add_fetch(&((neo_Head*)data - 1)->ref, 1, __ATOMIC_RELAXED);
+
+    return data;
+}
+
+
+// release reference to selection data
+void neo_free(uint8_t* data)
+{
+    neo_Head* head = (data != NULL) ? (neo_Head*)data - 1 : NULL;
+
+    if (head != NULL && __atomic_sub_fetch(&head->ref, 1, __ATOMIC_ACQ_REL) == 0) {
+        if (head->fd >= 0) {
+            close(head->fd);
+            munmap(head, head->size);
+        } else
+            free(head);
+    }
+}
+
+
+// get memfd holding selection data
+// *poff is file offset of data[0]
+// (return -1) => not in memfd
+int neo_memfd(const uint8_t* data, size_t* poff)
+{
+    *poff = sizeof(neo_Head);
+    return (data != NULL) ? ((const neo_Head*)data - 1)->fd : -1;
+}
+
+
+// cut truncated text at last newline
+// (no newline) => keep it all
+size_t neo_cut(const uint8_t* ptr, size_t cb)
+{
+    for (size_t i = cb; i > 1; --i)
+        if (ptr[i - 1] == '\n')
+            return i - 1;
+    return cb;
+}
+
+
+// own new selection
+// (cb == 0) => empty selection
+void neo_own(lua_State* L, neo_X* x, bool offer, int sel, const void* ptr, size_t cb,
+    int type)
+{
+    uint8_t* data = neo_alloc(cb, type);
+    if (data != NULL)
+        memcpy(data + 1 + sizeof("utf-8"), ptr, cb);
+    neo_take(L, x, offer, sel, data, cb);
+}
+
+
+// wake up get_async waiters
+// Note: may be called from any thread
+void neo_notify(int sel)
+{
+    if (__atomic_load_n(&neo_wait[sel], __ATOMIC_ACQUIRE) > 0) {
+        uint8_t ch = sel;
+        while (write(neo_pipe[1], &ch, 1) < 0 && errno == EINTR)
+            /*nothing*/;
+    }
+}
+
+
+// LuaJIT FFI: acquire selection text until neoclip_release()
+// *pcb is valid text size, *ptype is MCHAR, MLINE or MBLOCK
+// (return NULL) => empty selection
+__attribute__((visibility("default")))
+const char* neoclip_acquire(const char* reg, size_t* pcb, int* ptype)
+{
+    int sel = (*reg == '*') ? sel_prim : sel_clip;
+    size_t cb = 0;
+
+    uint8_t* data = (neo_ffi_x != NULL) ? neo_peek(neo_ffi_x, sel, &cb) : NULL;
+    const char* ptr = (data != NULL) ? (char*)data + 1 + sizeof("utf-8") : NULL;
+
+    // chop invalid data and detect regtype as neo_split does
+    cb = (ptr != NULL) ? neo_scan(ptr, cb, NULL, NULL) : 0;
+    *pcb = cb;
+    *ptype = (data != NULL && data[0] <= MBLOCK) ? data[0] :
+        (cb > 0 && ptr[cb - 1] != 10 && ptr[cb - 1] != 13) ? MCHAR : MLINE;
+
+    return ptr;
+}
+
+
+// LuaJIT FFI: release text from neoclip_acquire() or neoclip_alloc()
+__attribute__((visibility("default")))
+void neoclip_release(const char* ptr)
+{
+    if (ptr != NULL)
+        neo_free((uint8_t*)ptr - 1 - sizeof("utf-8"));
+}
+
+
+// LuaJIT FFI: allocate text buffer for neoclip_publish()
+__attribute__((visibility("default")))
+char* neoclip_alloc(size_t cb)
+{
+    uint8_t* data = neo_alloc(cb, MAUTO);
+    return (data != NULL) ? (char*)data + 1 + sizeof("utf-8") : NULL;
+}
+
+
+// LuaJIT FFI: own new selection from neoclip_alloc() buffer
+// Note: buffer is released in any case
+__attribute__((visibility("default")))
+bool neoclip_publish(const char* reg, char* ptr, size_t cb, const char* regtype)
+{
+    int sel = (*reg == '*') ? sel_prim : sel_clip;
+    uint8_t* data = (ptr != NULL) ? (uint8_t*)ptr - 1 - sizeof("utf-8") : NULL;
+
+    if (neo_ffi_x == NULL) {
+        neo_free(data);
+        return false;
+    }
+
+    if (data != NULL)
+        data[0] = neo_type(*regtype);
+    neo_take(NULL, neo_ffi_x, true, sel, data, cb);
+    return true;
+}
+
+
+// LuaJIT FFI: LF offsets in text (see neo_scan)
+// returned array must be neoclip_free()'d
+__attribute__((visibility("default")))
+size_t* neoclip_lines(const char* ptr, size_t cb, size_t* pcount)
+{
+    size_t* lf = NULL;
+
+    *pcount = 0;
+    if (ptr != NULL && cb > 0)
+        neo_scan(ptr, cb, &lf, pcount);
+
+    return lf;
+}
+
+
+// LuaJIT FFI: free memory from neoclip_lines()
+__attribute__((visibility("default")))
+void neoclip_free(void* ptr)
+{
+    free(ptr);
+}
+
+
+// create notification pipe and start polling it
+static bool async_init(lua_State* L)
+{
+    if (neo_pipe[0] >= 0)
+        return true;
+
+    if (pipe(neo_pipe) < 0) {
+        neo_pipe[0] = neo_pipe[1] = -1;
+        return false;
+    }
+    for (size_t i = 0; i < 2; ++i) {
+        fcntl(neo_pipe[i], F_SETFL, O_NONBLOCK);
+        fcntl(neo_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    // uv_share.wait = { {}, {}, ... }
+    lua_createtable(L, sel_total, 0);
+    for (int i = 1; i <= sel_total; ++i) {
+        lua_newtable(L);
+        lua_rawseti(L, -2, i);
+    }
+    lua_setfield(L, uv_share, "wait");
+
+    push_uv(L);                         // uv => stack
+    // local notify = uv.new_poll(neo_pipe[0])
+    lua_getfield(L, -1, "new_poll");
+    lua_pushinteger(L, neo_pipe[0]);
+    lua_call(L, 1, 1);                  // notify => stack
+    // uv.poll_start(notify, "r", cb_notify)
+    lua_getfield(L, -2, "poll_start");
+    lua_pushvalue(L, -2);
+    lua_pushliteral(L, "r");
+    neo_pushcfunction(L, cb_notify);
+    lua_call(L, 3, 0);
+    // uv_share.notify = notify
+    lua_setfield(L, uv_share, "notify");    // notify <= stack
+    lua_pop(L, 1);                      // uv <= stack
+
+    return true;
+}
+
+
+// remove get_async request at index ix
+// (return false) => not pending
+static bool async_drop(lua_State* L, int ix)
+{
+    lua_getfield(L, ix, "sel");
+    int sel = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+
+    // uv_share.wait[sel][req]?
+    push_wait(L, sel);                  // wait => stack
+    lua_pushvalue(L, ix);
+    lua_rawget(L, -2);
+    bool pending = !lua_isnil(L, -1);
+    lua_pop(L, 1);
+
+    if (pending) {
+        // uv_share.wait[sel][req] = nil
+        lua_pushvalue(L, ix);
+        lua_pushnil(L);
+        lua_rawset(L, -3);
+        __atomic_sub_fetch(&neo_wait[sel], 1, __ATOMIC_RELEASE);
+
+        // uv.close(req.timer)
+        push_uv(L);
+        lua_getfield(L, -1, "close");
+        lua_getfield(L, ix, "timer");
+        lua_call(L, 1, 0);
+        lua_pop(L, 1);
+    }
+
+    lua_pop(L, 1);                      // wait <= stack
+    return pending;
+}
+
+
+// get_async cancel function => boolean
+static int async_cancel(lua_State* L)
+{
+    lua_pushboolean(L, async_drop(L, lua_upvalueindex(3)));
+    return 1;
+}
+
+
+// uv_timer_t callback: get_async timeout
+static int cb_expire(lua_State* L)
+{
+    if (async_drop(L, lua_upvalueindex(3))) {
+        lua_getfield(L, lua_upvalueindex(3), "cb");
+        lua_call(L, 0, 0);
+    }
+
+    return 0;
+}
+
+
+// uv_poll_t callback: selection is ready
+static int cb_notify(lua_State* L)
+{
+    bool ready[sel_total] = { false };
+    uint8_t buf[64];
+    ssize_t n;
+
+    while ((n = read(neo_pipe[0], buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR))
+        for (ssize_t i = 0; i < n; ++i)
+            if (buf[i] < sel_total)
+                ready[buf[i]] = true;
+
+    neo_X* x = neo_x(L);
+    lua_settop(L, 0);
+    lua_pushnil(L);                     // first error => stack (1)
+
+    for (int sel = 0; sel < sel_total; ++sel) {
+        if (!ready[sel])
+            continue;
+
+        // take all waiters
+        lua_newtable(L);                // reqs => stack (2)
+        int count = 0;
+        push_wait(L, sel);
+        lua_pushnil(L);
+        while (lua_next(L, -2)) {
+            lua_pop(L, 1);
+            lua_pushvalue(L, -1);
+            lua_rawseti(L, 2, ++count);
+        }
+        lua_pop(L, 1);
+        for (int i = 1; i <= count; ++i) {
+            lua_rawgeti(L, 2, i);
+            async_drop(L, 3);
+            lua_pop(L, 1);
+        }
+
+        // callback(lines, regtype, truncated)
+        size_t cb = 0;
+        uint8_t* data = (x != NULL) ? neo_peek(x, sel, &cb) : NULL;
+        bool trunc = (data != NULL && neo_truncated(x, sel));
+        for (int i = 1; i <= count; ++i) {
+            lua_rawgeti(L, 2, i);
+            lua_getfield(L, -1, "cb");
+            lua_replace(L, -2);
+            lua_createtable(L, 2, 0);
+            if (data != NULL && cb > 0)
+                neo_split(L, -1, data + 1 + sizeof("utf-8"), cb, data[0]);
+            lua_rawgeti(L, -1, 1);
+            lua_rawgeti(L, -2, 2);
+            lua_remove(L, -3);
+            lua_pushboolean(L, trunc);
+            if (lua_pcall(L, 3, 0, 0) != 0) {
+                // keep first error only
+                if (lua_isnil(L, 1))
+                    lua_replace(L, 1);
+                else
+                    lua_pop(L, 1);
+            }
+        }
+        neo_free(data);
+        lua_pop(L, 1);                  // reqs <= stack
+    }
+
+    return lua_isnil(L, 1) ? 0 : lua_error(L);
+}
+
+
+// push vim.uv or vim.loop
+static void push_uv(lua_State* L)
+{
+    lua_getglobal(L, "vim");
+    lua_getfield(L, -1, "uv");
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_getfield(L, -1, "loop");
+    }
+    lua_replace(L, -2);
+}
+
+
+// push uv_share.wait[sel]
+static void push_wait(lua_State* L, int sel)
+{
+    lua_getfield(L, uv_share, "wait");
+    lua_rawgeti(L, -1, sel + 1);
+    lua_replace(L, -2);
+}
+
+
+// push closure with upvalue 3 : value at index ix
+static void push_closure(lua_State* L, lua_CFunction fn, int ix)
+{
+    lua_pushvalue(L, ix);
+    lua_pushvalue(L, uv_module);        // upvalue 1 : module name
+    lua_pushvalue(L, uv_share);         // upvalue 2 : shared table
+    lua_pushvalue(L, -3);               // upvalue 3
+    lua_pushcclosure(L, fn, 3);
+    lua_replace(L, -2);
+}
+
+
+// (re)allocate memfd mapping of size octets
+// heap data is moved into memfd (and freed)
+// (return NULL) => failed, old data is intact
+static neo_Head* map_alloc(neo_Head* head, size_t size)
+{
+#if defined(MFD_CLOEXEC)
+    int fd = (head != NULL && head->fd >= 0) ? head->fd : memfd_create("neoclip",
+        MFD_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    neo_Head* head2 = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+        head2 = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (head2 == MAP_FAILED) {
+        if (head == NULL || head->fd < 0)
+            close(fd);
+        return NULL;
+    }
+
+    if (head == NULL) {
+        // new data
+        head2->fd = fd;
+    } else if (head->fd >= 0) {
+        // same file, new mapping
+        munmap(head, head->size);
+    } else {
+        // move from heap
+        memcpy(head2, head, (head->size < size) ? head->size : size);
+        head2->fd = fd;
+        free(head);
+    }
+    head2->size = size;
+
+    return head2;
+#else
+    (void)head; // unused
+    (void)size; // unused
+    return NULL;
+#endif // MFD_CLOEXEC
+}
@@ -1,6 +1,6 @@
 /*
  * neoclip - Neovim clipboard provider
- * Last Change:  2025 Jun 21
+ * Last Change:  2026 Oct 16
  * License:      https://unlicense.org
  * URL:          https://github.com/matveyt/neoclip
  */
@@ -33,10 +33,43 @@ enum {
 // driver state : incomplete type
 typedef struct neo_X neo_X;
 
-void neo_fetch(lua_State* L, int ix, int sel);
-void neo_own(neo_X* x, bool offer, int sel, const void* ptr, size_t cb, int type);
+// driver state for LuaJIT FFI (NULL if stopped)
+extern neo_X* neo_ffi_x;
+// selection size to store in memfd (0 => never)
+// Note: set before event thread starts and never again
+extern size_t neo_memfd_min;
+#define MEMFD_MIN 0x400000
 
-// inline helper
+// neo_fetch flags
+enum {
+    fetch_full = 1,     // fetch again if truncated
+    fetch_sent = 2,     // request was sent by neo_request
+};
+
+// driver implementation
+bool neo_fetch(lua_State* L, int ix, int sel, int flags, neo_Reader fn);
+void neo_take(lua_State* L, neo_X* x, bool offer, int sel, uint8_t* data, size_t cb);
+uint8_t* neo_peek(neo_X* x, int sel, size_t* pcb);
+bool neo_truncated(neo_X* x, int sel);
+bool neo_request(lua_State* L, int sel);
+void neo_count(neo_X* x, lua_State* L);
+
+// neoclip_nix.c
+int neo_update(lua_State* L);   // lua_CFunction(reg, full) => boolean
+int neo_get_many(lua_State* L); // lua_CFunction(regs) => table
+int neo_stats(lua_State* L);    // lua_CFunction() => table or nil
+int neo_get_async(lua_State* L);    // lua_CFunction(reg, cb, timeout) => function
+uint8_t* neo_alloc(size_t cb, int type);
+uint8_t* neo_realloc(uint8_t* data, size_t cb);
+uint8_t* neo_ref(uint8_t* data);
+void neo_free(uint8_t* data);
+int neo_memfd(const uint8_t* data, size_t* poff);
+size_t neo_cut(const uint8_t* ptr, size_t cb);
+void neo_own(lua_State* L, neo_X* x, bool offer, int sel, const void* ptr, size_t cb,
+    int type);
+void neo_notify(int sel);
+
+// inline helpers
 static inline neo_X* neo_x(lua_State* L)
 {
     luaL_checktype(L, uv_share, LUA_TTABLE);
@@ -45,6 +78,33 @@ static inline neo_X* neo_x(lua_State* L)
     lua_pop(L, 1);
     return x;
 }
+static inline bool neo_opt(lua_State* L, const char* name)
+{
+    // uv_share.opts[name] (see neo_start)
+    lua_getfield(L, uv_share, "opts");
+    bool opt = false;
+    if (lua_istable(L, -1)) {
+        lua_getfield(L, -1, name);
+        opt = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+    return opt;
+}
+static inline lua_Integer neo_optint(lua_State* L, const char* name, lua_Integer def)
+{
+    // uv_share.opts[name] or def (see neo_start)
+    lua_getfield(L, uv_share, "opts");
+    lua_Integer opt = def;
+    if (lua_istable(L, -1)) {
+        lua_getfield(L, -1, name);
+        if (lua_isnumber(L, -1))
+            opt = lua_tointeger(L, -1);
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+    return opt;
+}
 
 
 #endif // NEOCLIP_NIX_H
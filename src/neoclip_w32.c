@@ -1,6 +1,6 @@
 /*
  * neoclip - Neovim clipboard provider
- * Last Change:  2025 Jun 21
+ * Last Change:  2026 Oct 16
  * License:      https://unlicense.org
  * URL:          https://github.com/matveyt/neoclip
  */
@@ -19,6 +19,9 @@ struct neo_UD {
 
 
 // forward prototypes
+static void get_clip(lua_State* L, neo_UD* ud, neo_Reader fn);
+static void get_lf(lua_State* L, int ix, const void* data, size_t cb, int type);
+static bool set_clip(neo_UD* ud, LPCSTR pSrc, size_t cchSrc, int type);
 static HANDLE get_and_lock(UINT uFormat, LPVOID ppData, size_t* pcbMax);
 static bool unlock_and_set(UINT uFormat, HANDLE hData);
 static HANDLE mb2wc(UINT cp, LPCVOID pSrc, size_t cchSrc, LPVOID ppDst, size_t* pcch);
@@ -36,6 +39,8 @@ int luaopen_driver(lua_State* L)
         { "status", neo_true },
         { "get", neo_get },
         { "set", neo_set },
+        { "get_raw", neo_get_raw },
+        { "set_raw", neo_set_raw },
         { NULL, NULL }
     };
 
@@ -77,8 +82,84 @@ int neo_get(lua_State* L)
 
     // a table to return
     lua_createtable(L, 2, 0);
+    get_clip(L, ud, neo_split);
+
+    // always return table (empty on error)
+    return 1;
+}
+
+
+// get_raw(regname) => string, regtype
+int neo_get_raw(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TSTRING);  // regname (unused)
+    neo_UD* ud = neo_checkud(L, uv_share);
+
+    // [string, regtype]
+    lua_createtable(L, 2, 0);
+    get_clip(L, ud, get_lf);
+
+    // nil on error
+    lua_rawgeti(L, -1, 1);
+    lua_rawgeti(L, -2, 2);
+    return 2;
+}
+
+
+// set(regname, lines, regtype) => boolean
+int neo_set(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TSTRING);  // regname (unused)
+    luaL_checktype(L, 2, LUA_TTABLE);   // lines
+    luaL_checktype(L, 3, LUA_TSTRING);  // regtype
+    neo_UD* ud = neo_checkud(L, uv_share);
+
+    // table to string
+    neo_join(L, 2, "\r\n");
+
+    size_t cb;
+    const char* ptr = lua_tolstring(L, -1, &cb);
+    lua_pushboolean(L, set_clip(ud, ptr, cb, neo_type(*lua_tostring(L, 3))));
+    return 1;
+}
+
+
+// set_raw(regname, string, regtype) => boolean
+int neo_set_raw(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TSTRING);  // regname (unused)
+    luaL_checktype(L, 2, LUA_TSTRING);  // string
+    luaL_checktype(L, 3, LUA_TSTRING);  // regtype
+    neo_UD* ud = neo_checkud(L, uv_share);
+
+    size_t cb;
+    const char* ptr = lua_tolstring(L, 2, &cb);
+
+    // bare LF to CRLF as in neo_set
+    size_t lf = 0;
+    for (size_t i = 0; i < cb; ++i)
+        lf += (ptr[i] == 10 && (i == 0 || ptr[i - 1] != 13));
+    if (lf > 0) {
+        char* buf = lua_newuserdata(L, cb + lf + 1);
+        for (size_t i = 0, j = 0; i <= cb; ++i) {
+            if (i < cb && ptr[i] == 10 && (i == 0 || ptr[i - 1] != 13))
+                buf[j++] = 13;
+            buf[j++] = ptr[i];  // incl. NUL
+        }
+        ptr = buf;
+        cb += lf;
+    }
+
+    lua_pushboolean(L, set_clip(ud, ptr, cb, neo_type(*lua_tostring(L, 3))));
+    return 1;
+}
+
+
+// read clipboard and pass UTF-8 text to reader function
+static void get_clip(lua_State* L, neo_UD* ud, neo_Reader fn)
+{
     if (!OpenClipboard(NULL))
-        return 1;
+        return;
 
     // get Vim meta
     int meta[4] = {
@@ -136,33 +217,45 @@ int neo_get(lua_State* L)
     if (hData != NULL) {
         // note: pBuf may contain trailing NUL
         if (pBuf != NULL)
-            neo_split(L, -1, pBuf, count, meta[0]);
+            fn(L, -1, pBuf, count, meta[0]);
         if (hBuf != NULL)
             GlobalUnlock(hBuf), GlobalFree(hBuf);
         GlobalUnlock(hData);
     }
     CloseClipboard();
-    return 1;
 }
 
 
-// set(regname, lines, regtype) => boolean
-int neo_set(lua_State* L)
+// neo_raw with CRLF to LF as in neo_split
+static void get_lf(lua_State* L, int ix, const void* data, size_t cb, int type)
 {
-    luaL_checktype(L, 1, LUA_TSTRING);  // regname (unused)
-    luaL_checktype(L, 2, LUA_TTABLE);   // lines
-    luaL_checktype(L, 3, LUA_TSTRING);  // regtype
-    neo_UD* ud = neo_checkud(L, uv_share);
+    const char* pb = data;
+    char* buf = (pb != NULL && cb > 1 && memchr(pb, 13, cb - 1) != NULL) ?
+        malloc(cb) : NULL;
+
+    if (buf != NULL) {
+        size_t j = 0;
+        for (size_t i = 0; i < cb; ++i)
+            if (pb[i] != 13 || i + 1 == cb || pb[i + 1] != 10)
+                buf[j++] = pb[i];
+        neo_raw(L, ix, buf, j, type);
+        free(buf);
+    } else
+        neo_raw(L, ix, data, cb, type);
+}
 
+
+// set clipboard from UTF-8 text (pSrc must be NUL terminated)
+static bool set_clip(neo_UD* ud, LPCSTR pSrc, size_t cchSrc, int type)
+{
     bool success = OpenClipboard(NULL);
     if (success) {
         EmptyClipboard();
-        neo_join(L, 2, "\r\n");
 
-        // get UTF-8
+        // get UTF-8 with NUL
         size_t cchACP = 0;
-        size_t cchUCS, cchSrc;
-        LPCSTR pSrc = lua_tolstring(L, -1, &cchSrc); ++cchSrc;
+        size_t cchUCS;
+        ++cchSrc;
         HANDLE hBuf;
         LPVOID pBuf;
 
@@ -190,7 +283,7 @@ int neo_set(lua_State* L)
         hBuf = GlobalAlloc(GMEM_MOVEABLE, sizeof(int) * 4);
         if (hBuf != NULL) {
             int* pMeta = GlobalLock(hBuf);
-            *pMeta++ = neo_type(*lua_tostring(L, 3));   // type
+            *pMeta++ = type;                            // type
             *pMeta++ = cchACP ? cchACP - 1 : INT_MAX;   // ACP len
             *pMeta++ = cchUCS ? cchUCS - 1 : INT_MAX;   // UCS len
             *pMeta   = sizeof("utf-8") + cchSrc - 1;    // Raw len
@@ -200,8 +293,7 @@ int neo_set(lua_State* L)
         CloseClipboard();
     }
 
-    lua_pushboolean(L, success);
-    return 1;
+    return success;
 }
 
 